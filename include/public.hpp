@@ -15,6 +15,14 @@ enum EnMsgType
     CREATE_GROUP_MSG, // 创建群组
     ADD_GROUP_MSG,    // 加入群组
     GROUP_CHAT_MSG,   // 群组聊天
+
+    GROUP_MEMBERS_MSG,     // 分页查询群组成员
+    GROUP_MEMBERS_MSG_ACK, // 群组成员分页响应
+
+    OFFLINE_MSG,     // 拉取离线消息，同时确认上一页
+    OFFLINE_MSG_ACK, // 离线消息分页响应
+
+    MSG_TYPE_MAX, // 消息类型数量的哨兵，新的消息类型加在它前面
 };
 
 #endif // PUBLIC_H
\ No newline at end of file
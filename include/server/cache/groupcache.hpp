@@ -0,0 +1,41 @@
+#ifndef GROUPCACHE_H
+#define GROUPCACHE_H
+
+#include <unordered_map>
+#include <shared_mutex>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <atomic>
+
+// 群组成员缓存：群组id -> 成员id数组
+// 第一次访问时从数据库加载，群组成员变化时失效，群聊时不再访问数据库
+class GroupCache
+{
+public:
+    // 成员列表不可修改，读者拿到后可以在锁外遍历
+    using MemberList = std::shared_ptr<const std::vector<int>>;
+    // 从数据库加载群组成员的方法
+    using Loader = std::function<std::vector<int>(int)>;
+
+    GroupCache(const Loader &loader, size_t capacity);
+
+    // 获取群组的全部成员，未缓存时加载
+    MemberList getMembers(int groupid);
+    // 群组成员变化后使缓存失效，下次访问重新加载
+    void invalidate(int groupid);
+
+    size_t size() const;
+
+private:
+    Loader _loader;
+    size_t _capacity; // 最多缓存的群组数
+
+    mutable std::shared_mutex _mutex;
+    std::unordered_map<int, MemberList> _groups;
+
+    // 每次失效加一，加载期间发生过失效的结果不放入缓存，避免缓存旧数据
+    std::atomic<unsigned long> _generation;
+};
+
+#endif // GROUPCACHE_H
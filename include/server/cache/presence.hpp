@@ -0,0 +1,53 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// 全集群在线用户目录的本机副本，回答“用户在哪台服务器上在线”
+// Redis中的路由表是权威数据，本机副本在启动时加载，之后随上下线通知更新
+class PresenceDirectory
+{
+public:
+    PresenceDirectory();
+
+    // 用户在node上上线，已在其他服务器上时覆盖
+    void insert(int userid, const std::string &node);
+    // 用户从node下线，用户已经登录到其他服务器时不删除
+    void erase(int userid, const std::string &node);
+    // 用户是否在线，只加一个分片的读锁
+    bool contains(int userid) const;
+    // 用户所在的服务器，不在线返回空串
+    std::string nodeOf(int userid) const;
+
+    // 全集群在线用户数
+    size_t size() const { return _size; }
+
+private:
+    static const int kShardCount = 64; // 分片数，必须是2的幂
+
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        // 用户id -> 服务器编号
+        std::unordered_map<int, int> users;
+    };
+
+    Shard &shardOf(int userid) { return _shards[static_cast<unsigned>(userid) & (kShardCount - 1)]; }
+    const Shard &shardOf(int userid) const { return _shards[static_cast<unsigned>(userid) & (kShardCount - 1)]; }
+
+    // 服务器名只有几十个，每个用户只记录编号，名字只存一份
+    int internNode(const std::string &node);
+
+    Shard _shards[kShardCount];
+    std::atomic<size_t> _size;
+
+    mutable std::shared_mutex _nodeMutex;
+    std::vector<std::string> _nodes;
+    std::unordered_map<std::string, int> _nodeIndex;
+};
+
+#endif // PRESENCE_H
@@ -1,8 +1,16 @@
 #ifndef CHATSERVER_H
 #define CHATSERVER_H
 
+#include "codec.hpp"
+#include "workerpool.hpp"
 #include <muduo/net/TcpServer.h>
 #include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <utility>
 
 using namespace muduo;
 using namespace muduo::net;
@@ -12,24 +20,78 @@ class ChatServer
 {
 public:
     // 初始化聊天服务器对象
+    // workerThreads：业务线程数量，queueCapacity：每个业务线程的队列容量
+    // ioThreads：IO线程数量，0表示与CPU核数相同；pinCpu：每个IO线程绑定到一个CPU核上
+    // reusePort：每个IO线程用SO_REUSEPORT各自监听同一端口，由内核分配新连接，不再只有一个线程accept
+    // maxMessageLen：单条消息的最大长度
     ChatServer(EventLoop *loop,
                const InetAddress &listenAddr,
-               const string &nameArg);
+               const string &nameArg,
+               int workerThreads = 8,
+               size_t queueCapacity = 65536,
+               int ioThreads = 0,
+               bool pinCpu = false,
+               bool reusePort = false,
+               int32_t maxMessageLen = ChatCodec::kDefaultMaxMessageLen);
+    ~ChatServer();
 
     // 启动服务
     void start();
 
+    // 网络模块的运行状态：每个IO线程上的连接数、业务线程队列中等待的消息数，追加到stats中
+    void stats(std::vector<std::pair<string, long long>> &stats);
+
 private:
+    // 在loop上创建一个监听listenAddr的TcpServer，注册好回调
+    TcpServer *addServer(EventLoop *loop, TcpServer::Option option);
+
+    // IO线程启动时的回调，开启绑核时把线程绑定到下一个CPU核上
+    void onThreadInit(EventLoop *loop);
+
+    // 累计IO线程loop上的连接数
+    void countConnection(EventLoop *loop, int delta);
+
     // 连接相关信息的回调函数（新连接创建/旧连接断开）
     void onConnection(const TcpConnectionPtr &);
 
-    // 读写事件相关信息的回调函数
+    // 编解码器切出一条完整消息后的回调函数，把消息交给业务线程处理
     void onMessage(const TcpConnectionPtr &,
-                   Buffer *,
+                   Packet &,
                    Timestamp);
 
-    TcpServer _server; // 组合的muduo库，实现服务器功能的类对象
-    EventLoop *_loop;  // 指向事件循环对象的指针
+    // 在业务线程中调用消息对应的处理器
+    void dispatch(const TcpConnectionPtr &, Packet &, Timestamp);
+
+    // 选择业务线程的key：同一用户的消息总是由同一个业务线程按顺序处理
+    size_t dispatchKey(const TcpConnectionPtr &, int sender);
+
+    EventLoop *_loop;     // 指向主事件循环对象的指针
+    InetAddress _listenAddr;
+    string _name;
+    ChatCodec _codec;     // 消息编解码器，负责分帧
+    WorkerPool _workers;  // 业务线程池，IO线程不再执行阻塞的数据库操作
+    int _ioThreads;       // IO线程数量
+    bool _pinCpu;         // IO线程是否绑核
+    bool _reusePort;      // 是否每个IO线程各自监听端口
+    std::atomic_int _nextCpu; // 下一个要绑定的CPU核
+
+    // 指标编号：连接建立/断开数、收到的消息数，消息从收到到开始处理的等待时间，断开连接的处理耗时
+    int _connectedCounter;
+    int _disconnectedCounter;
+    int _messageCounter;
+    int _queueWaitMetric;
+    int _closeMetric;
+
+    // 组合的muduo库，实现服务器功能的类对象
+    // 默认只有一个，在主循环中accept，新连接轮流分给subLoop
+    // reusePort模式下每个IO线程一个，第一个在主循环中，其余的在各自的IO线程中创建、启动和销毁
+    std::vector<std::unique_ptr<TcpServer>> _servers;
+    // 每个IO线程上的连接数，按IO线程第一次建立连接的顺序排列；连接建立/断开不频繁，加锁即可
+    std::mutex _loopMutex;
+    std::vector<std::pair<EventLoop *, long long>> _loopConnections;
+
+    // reusePort模式下除主循环以外的IO线程
+    std::vector<std::unique_ptr<EventLoopThread>> _loopThreads;
 };
 
 #endif // CHATSERVER_H
@@ -1,22 +1,33 @@
 #ifndef CHATSERVICE_H
 #define CHATSERVICE_H
 
-#include "json.hpp"
+#include "public.hpp"
+#include "packet.hpp"
+#include "codec.hpp"
 #include "usermodel.hpp"
+#include "userstatewriter.hpp"
 #include "offlinemessagemodel.hpp"
 #include "friendmodel.hpp"
 #include "groupmodel.hpp"
+#include "loginmodel.hpp"
 #include "redis.hpp"
+#include "connectionregistry.hpp"
+#include "groupcache.hpp"
+#include "presence.hpp"
+#include "workerpool.hpp"
 #include <muduo/net/TcpConnection.h>
 #include <unordered_map>
 #include <functional>
-#include <mutex>
 
 using namespace muduo;
 using namespace muduo::net;
-// 表示处理消息的事件回调方法类型
-using json = nlohmann::json;
-using MsgHandler = std::function<void(const TcpConnectionPtr &, json &, Timestamp)>;
+
+// 跨服务器消息的路由方式，集群中所有服务器必须一致
+enum RouteMode
+{
+    ROUTE_PER_USER = 0, // 每个在线用户订阅一个以用户id命名的通道
+    ROUTE_PER_NODE,     // 每台服务器只订阅自己的通道，消息按路由表发往接收方所在的服务器
+};
 
 // 聊天服务器业务类
 class ChatService
@@ -26,56 +37,121 @@ public:
     // 获取单例对象的接口函数
     static ChatService *instance();
 
+    // 表示处理消息的事件回调方法类型，直接指向成员函数，分发时不需要拷贝或分配
+    using MsgHandler = void (ChatService::*)(const TcpConnectionPtr &, Packet &, Timestamp);
+
+    // 连接Redis并订阅通知通道，nodeId是本机在集群中的名字（server.node_id，默认主机名:端口），集群中必须唯一
+    void init(const string &nodeId, RouteMode mode);
+    // 更换离线消息的存储，默认存在MySQL中，只能在服务启动前调用
+    void setOfflineStore(unique_ptr<OfflineStore> store);
+    // 设置业务线程池，Redis事件循环中收到的消息需要访问数据库时交给它处理
+    void setWorkerPool(WorkerPool *workers) { _workers = workers; }
+
     // 登录业务
-    void loginHandler(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void loginHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
     // 处理注销业务
-    void loginout(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void loginout(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
     // 注册业务
-    void registerHandler(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void registerHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
 
     // 一对一聊天业务
-    void oneChatHandler(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void oneChatHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
     // 添加好友业务
-    void addFriendHandler(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void addFriendHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
 
     // 创建群组业务
-    void createGroup(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void createGroup(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
     // 加入群组业务
-    void addGroup(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void addGroup(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
     // 群组聊天业务
-    void groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void groupChat(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
+    // 分页查询群组成员业务
+    void groupMembersHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
+
+    // 拉取离线消息业务
+    void offlineMsgHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
 
     // 处理客户端异常退出
     void clientCloseExceptionHandler(const TcpConnectionPtr &conn);
     // 服务端异常终止，业务重置方法
     void reset();
 
-    // 获取消息对应的处理器
-    MsgHandler getHandler(int msgId);
+    // 业务模块的运行状态：在线用户数、离线消息积压、等待发布的消息数，追加到stats中
+    void stats(std::vector<std::pair<string, long long>> &stats);
+
+    // 按msgid调用对应的处理器，msgid没有对应的处理器时只记录错误日志
+    void dispatch(const TcpConnectionPtr &conn, Packet &packet, Timestamp time);
 
-    // 从redis消息队列中获取订阅的消息
+    // 从redis消息队列中获取订阅的消息（按用户路由）
     void redis_subscribe_message_handler(int channel, string message);
 
+    // 从redis控制通道中获取其他服务器的通知（如群组成员变化）
+    void redis_control_message_handler(string channel, string message);
+
 private:
     ChatService();
 
-    // 存储消息id和其对应的业务处理方法
-    std::unordered_map<int, MsgHandler> _msgHandlerMap;
+    // 把二进制帧转发给userid所在的服务器node，帧保留了头部信息
+    // payload是消息的原始载荷，没有送达时用来转储离线消息
+    void forward(int userid, const string &node, const FramePtr &frame, const shared_ptr<const string> &payload);
+
+    // 其他服务器发到本机通道的消息（按服务器路由）
+    void nodeMessageHandler(const string &message);
+
+    // 把会访问数据库的任务按key交给业务线程，不在Redis的事件循环中阻塞
+    void runInWorker(size_t key, WorkerPool::Task task);
 
-    // 存储在线用户的通信连接，会随着用户上线/下线不断该笔，其访问需要注意线程安全
-    std::unordered_map<int, TcpConnectionPtr> _userConnMap;
+    // 把跨服务器送来的消息交给本机的用户，用户已不在本机时转储离线消息
+    void deliver(int userid, const Packet &packet);
 
-    // 定义互斥锁，保证_userConnMap的线程安全
-    std::mutex _connMutex;
+    // 把群消息发给本机连接上的群友（发送者除外），frames缓存每种格式编码好的帧
+    // 返回不在本机连接上的群友
+    vector<int> fanOutLocal(const Packet &packet, FramePtr (&frames)[2]);
+
+    // 其他服务器转来的群消息，在本机扇出
+    void deliverGroup(const Packet &packet);
+
+    // 发布结果的回调，消息没有送达任何订阅者时转储为userids的离线消息
+    Redis::PublishCallback offlineOnMiss(vector<int> userids, shared_ptr<const string> payload);
+
+    // 群组成员变化：本机缓存失效，并通知其他服务器
+    void invalidateGroup(int groupid);
+
+    // 更新用户的在线状态：本机目录、Redis路由表，并通知其他服务器
+    void setOnline(int userid, bool online);
+
+    // 存储在线用户的通信连接，会随着用户上线/下线不断改变，内部按用户id分片加锁保证线程安全
+    ConnectionRegistry _userConnMap;
 
     // 数据操作类对象
     UserModel _userModel;
+    // 用户状态延迟写入，上下线不再同步更新user表
+    UserStateWriter _userStateWriter;
     OfflineMsgModel _offlineMsgModel;
     FriendModel _friendModel;
     GroupModel _groupModel;
+    LoginModel _loginModel;
+
+    // 群组成员缓存，群聊时不再查询数据库
+    GroupCache _groupCache;
+
+    // 全集群在线用户目录，判断接收方是否在线时不再查询数据库
+    PresenceDirectory _presence;
 
     // Redis操作对象
     Redis _redis;
+
+    // 业务线程池，由ChatServer设置
+    WorkerPool *_workers;
+
+    // 每种消息处理耗时的直方图编号，按msgid索引；没有处理器的消息计数
+    int _handlerMetrics[MSG_TYPE_MAX];
+    int _unknownMsgMetric;
+
+    // 本机在集群中的名字和订阅的通道
+    string _nodeId;
+    string _nodeChannel;
+    RouteMode _routeMode;
 };
 
 #endif // CHATSERVICE_H
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "packet.hpp"
+#include <muduo/net/TcpConnection.h>
+#include <functional>
+#include <memory>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// 编码好的一帧，群发时所有接收方共享同一份，只增加引用计数
+using FramePtr = std::shared_ptr<const string>;
+
+// 消息编解码器，解决TCP粘包/半包问题，按连接协商的格式分帧
+// JSON格式：| 4字节长度头（网络字节序）| json文本 |
+// 二进制格式：| 16字节固定头部（见Packet）| 载荷 |
+// 按服务器路由时，跨服务器的消息装在信封里：| 4字节接收方用户id（网络字节序）| 二进制帧 |
+// 接收方为kGroupRecipient时是群消息，由收到的服务器按帧头部的群组id在本机扇出
+class ChatCodec
+{
+public:
+    // 解出一条完整消息后的回调类型
+    using PacketCallback = std::function<void(const TcpConnectionPtr &, Packet &, Timestamp)>;
+
+    // 信封的接收方是整个群组
+    static const int kGroupRecipient = -1;
+    // 单条消息默认的最大长度
+    static const int32_t kDefaultMaxMessageLen = 64 * 1024 * 1024;
+
+    // maxMessageLen是单条消息的最大长度，超过时断开连接
+    explicit ChatCodec(const PacketCallback &cb, int32_t maxMessageLen = kDefaultMaxMessageLen);
+
+    // 注册给muduo的消息回调，一次切出Buffer中所有完整的帧，不完整的帧留在Buffer中
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time);
+
+    // 按指定格式把消息编码成一帧，追加到buf中
+    static void encode(const Packet &packet, int format, Buffer *buf);
+    // 从一段完整的二进制帧中解出消息
+    static bool decode(const char *data, size_t len, Packet &packet);
+
+    // 按指定格式把消息编码成一帧共享的缓冲区
+    static FramePtr encode(const Packet &packet, int format);
+
+    // 把二进制帧装进发往接收方所在服务器的信封
+    static FramePtr wrap(int recipient, const string &frame);
+    // 拆开信封，取出接收方和消息
+    static bool unwrap(const string &message, int &recipient, Packet &packet);
+
+    // 按接收方连接协商的格式编码后发送
+    static void send(const TcpConnectionPtr &conn, const Packet &packet);
+    // 发送已编码好的帧，跨线程发送时只传递引用，不拷贝帧内容
+    static void send(const TcpConnectionPtr &conn, const FramePtr &frame);
+
+private:
+    // 从Buffer中切一帧的结果
+    enum DecodeResult
+    {
+        kIncomplete, // 帧不完整，等待后续数据
+        kPacket,     // 解出一条消息
+        kSkipped,    // 帧完整但内容非法，已丢弃
+        kError,      // 长度非法，无法继续分帧
+    };
+
+    DecodeResult decodeJson(const TcpConnectionPtr &conn, Buffer *buf, Packet &packet);
+    DecodeResult decodeBinary(const TcpConnectionPtr &conn, Buffer *buf, Packet &packet);
+
+    static const int32_t kHeaderLen = sizeof(int32_t);
+
+    PacketCallback _messageCallback;
+    int32_t _maxMessageLen;
+};
+
+#endif // CODEC_H
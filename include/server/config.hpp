@@ -0,0 +1,42 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+// 服务器运行配置，单例模式
+// 配置文件每行一项“key = value”，#开头的行是注释；命令行中的“--key=value”优先于文件中的同名配置
+// 配置在main中启动服务之前加载，之后只读，多线程读取不需要加锁
+class Config
+{
+public:
+    // 获取配置单例对象
+    static Config *instance();
+
+    // 加载配置文件，文件中的配置不覆盖已经设置的同名配置，文件不存在或无法读取时返回false
+    bool load(const std::string &file);
+
+    // 解析命令行参数：“--key=value”写入配置，其余参数按顺序放入positional
+    void parseArgs(int argc, char **argv, std::vector<std::string> &positional);
+
+    // 设置一项配置，已存在时覆盖
+    void set(const std::string &key, const std::string &value) { _values[key] = value; }
+    bool contains(const std::string &key) const { return _values.count(key) != 0; }
+
+    // 读取配置，不存在或格式错误时返回默认值
+    std::string getString(const std::string &key, const std::string &def) const;
+    int getInt(const std::string &key, int def) const;
+    // 读取整数配置并限制在[min, max]内，超出范围时记录错误并取最近的边界值
+    int getInt(const std::string &key, int def, int min, int max) const;
+    double getDouble(const std::string &key, double def) const;
+    // true/yes/on/1为真，false/no/off/0为假
+    bool getBool(const std::string &key, bool def) const;
+
+private:
+    Config() = default;
+
+    std::unordered_map<std::string, std::string> _values;
+};
+
+#endif // CONFIG_H
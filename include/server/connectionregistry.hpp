@@ -0,0 +1,53 @@
+#ifndef CONNECTIONREGISTRY_H
+#define CONNECTIONREGISTRY_H
+
+#include <muduo/net/TcpConnection.h>
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+#include <atomic>
+
+using namespace muduo::net;
+
+// 在线用户的通信连接表，按用户id分片，每个分片一把读写锁
+// 不同分片之间互不竞争，查找只加读锁，多个IO线程可以同时查找同一分片
+class ConnectionRegistry
+{
+public:
+    ConnectionRegistry();
+
+    // 记录用户的连接，已存在时覆盖
+    void insert(int userid, const TcpConnectionPtr &conn);
+    // 删除用户的连接，返回是否存在
+    bool erase(int userid);
+    // 仅当用户当前的连接是conn时才删除，避免误删用户在新连接上的登录
+    bool erase(int userid, const TcpConnectionPtr &conn);
+    // 查找用户的连接，不在本机返回空指针
+    TcpConnectionPtr find(int userid) const;
+    // 批量查找，每个分片只加一次读锁，返回本机在线的连接，不在本机的用户id放入others
+    std::vector<TcpConnectionPtr> find(const std::vector<int> &userids, std::vector<int> &others) const;
+
+    // 本机全部在线用户的id
+    std::vector<int> userIds() const;
+
+    // 本机在线用户数
+    size_t size() const { return _size; }
+
+private:
+    static const int kShardCount = 64; // 分片数，必须是2的幂
+
+    // 按缓存行对齐，避免不同分片的锁之间伪共享
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<int, TcpConnectionPtr> conns;
+    };
+
+    Shard &shardOf(int userid) { return _shards[static_cast<unsigned>(userid) & (kShardCount - 1)]; }
+    const Shard &shardOf(int userid) const { return _shards[static_cast<unsigned>(userid) & (kShardCount - 1)]; }
+
+    Shard _shards[kShardCount];
+    std::atomic<size_t> _size;
+};
+
+#endif // CONNECTIONREGISTRY_H
@@ -0,0 +1,56 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include "db.h"
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+// MySQL连接池，单例模式
+// 借出的连接用shared_ptr管理，析构时自动归还到连接池，而不是关闭连接
+class ConnectionPool
+{
+public:
+    // 获取连接池单例对象
+    static ConnectionPool *instance();
+
+    // 从连接池中借出一个可用连接，超时或创建失败时返回nullptr
+    shared_ptr<MySQL> getConnection();
+
+    // 当前连接总数和空闲连接数
+    int totalSize() const { return _connectionCnt; }
+    int idleSize();
+
+    ~ConnectionPool();
+
+private:
+    ConnectionPool();
+
+    // 创建一个新连接，成功返回连接对象，失败返回nullptr
+    MySQL *createConnection();
+    // 把借出的连接归还到空闲队列
+    void releaseConnection(MySQL *conn);
+    // 扫描线程：回收空闲时间超过_maxIdleTime的多余连接
+    void scannerConnectionTask();
+
+    int _minSize;           // 连接池最少保持的连接数
+    int _maxSize;           // 连接池最多创建的连接数
+    int _maxIdleTime;       // 连接最长空闲时间（秒），超过的多余连接会被回收
+    int _pingIdleTime;      // 借出前空闲超过该时长（秒）的连接需要检查是否可用
+    int _connectionTimeout; // 连接用完时等待归还的超时时间（毫秒）
+
+    deque<MySQL *> _connectionQue; // 空闲连接队列，队尾是最近归还的连接
+    mutex _queueMutex;             // 保证_connectionQue的线程安全
+    condition_variable _cv;        // 连接归还时通知等待的线程
+    atomic_int _connectionCnt;     // 已创建的连接总数（空闲 + 借出）
+
+    bool _stop;                    // 通知扫描线程退出
+    condition_variable _scannerCv; // 唤醒扫描线程退出
+    thread _scanner;               // 回收空闲连接的扫描线程
+};
+
+#endif // CONNECTIONPOOL_H
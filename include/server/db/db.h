@@ -1,9 +1,12 @@
 #ifndef DB_H
 #define DB_H
 
-// TODO: 封装太简单，可以增加MySQL连接池
+#include "statement.hpp"
 #include <mysql/mysql.h>
 #include <string>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
 
 using namespace std;
 
@@ -21,11 +24,26 @@ public:
     bool update(string sql);
     // 查询操作
     MYSQL_RES *query(string sql);
+    // 获取预处理语句，同一连接上相同的SQL只预处理一次
+    Statement *prepare(const string &sql);
     // 获取连接
     MYSQL* getConnection();
+    // 检查连接是否可用
+    bool ping();
+
+    // 刷新连接进入空闲队列的时间
+    void refreshAliveTime() { _aliveTime = std::chrono::steady_clock::now(); }
+    // 连接已空闲的时长（秒）
+    double getIdleSeconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - _aliveTime).count();
+    }
 
 private:
     MYSQL *_conn;
+    // 该连接上预处理过的语句缓存，要先于_conn释放
+    unordered_map<string, unique_ptr<Statement>> _stmtCache;
+    std::chrono::steady_clock::time_point _aliveTime; // 进入空闲队列的时间
 };
 
 #endif // DB_H
@@ -0,0 +1,74 @@
+#ifndef STATEMENT_H
+#define STATEMENT_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 预处理语句的封装
+// SQL只在prepare时解析一次，之后每次执行只传参数，参数和结果都不受长度限制
+class Statement
+{
+public:
+    explicit Statement(MYSQL *conn);
+    ~Statement();
+
+    Statement(const Statement &) = delete;
+    Statement &operator=(const Statement &) = delete;
+
+    // 预处理SQL语句，参数用?占位
+    bool prepare(const string &sql);
+
+    // 绑定参数，index从0开始
+    void bindInt(int index, long long value);
+    void bindString(int index, const string &value);
+    // 绑定字符串参数但不拷贝，value必须在execute之前保持有效，用于同一个大字符串绑定多次
+    void bindStringRef(int index, const string &value);
+
+    // 执行语句，有结果集时会把结果全部缓存到客户端
+    bool execute();
+    // 读取下一行结果，没有更多行时返回false
+    bool fetch();
+
+    // 读取当前行第col列的值，col从0开始
+    int getInt(int col) const;
+    long long getInt64(int col) const;
+    string getString(int col) const;
+
+    // 插入生成的自增主键
+    unsigned long long insertId();
+    // 受影响的行数
+    unsigned long long affectedRows();
+
+private:
+    // 参数的存储区，MYSQL_BIND指向这里
+    struct Param
+    {
+        long long intValue;
+        string strValue;
+        unsigned long length;
+    };
+
+    // 结果列的存储区，列值超过缓冲区时按实际长度扩容
+    struct Column
+    {
+        vector<char> buffer;
+        unsigned long length;
+        bool isNull;
+        bool error;
+    };
+
+    // 把结果列绑定到语句上
+    bool bindResult();
+
+    MYSQL_STMT *_stmt;
+    string _sql;
+    vector<Param> _params;
+    vector<MYSQL_BIND> _paramBinds;
+    vector<Column> _columns;
+    vector<MYSQL_BIND> _resultBinds;
+};
+
+#endif // STATEMENT_H
@@ -0,0 +1,124 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// 运行指标，单例模式：计数器和延迟直方图
+// 每个线程第一次记录时分到自己的一块存储，之后只写自己的那块，不加锁也没有原子的读改写指令
+// 读取时把所有线程的数据加起来，只在注册指标、线程第一次记录时加锁
+//
+// 直方图的桶是HDR风格的对数线性分布：每个2的幂区间再等分成16个子桶，
+// 任意值落在桶中的误差不超过1/16，覆盖1微秒到约19小时，每个直方图只占几KB
+class Metrics
+{
+public:
+    // 获取指标单例对象
+    static Metrics *instance();
+
+    // 注册（或查找已注册的）直方图和计数器，返回之后记录时使用的编号
+    // 注册要加锁，调用方应该把编号保存下来，不要在每次记录时注册；超过上限时返回-1
+    int histogram(const std::string &name);
+    int counter(const std::string &name);
+
+    // 在直方图中记录一次耗时（微秒）
+    void record(int id, uint64_t micros);
+    // 计数器增加n
+    void add(int id, uint64_t n = 1);
+
+    // 一个直方图所有线程合计的快照
+    struct HistogramSnapshot
+    {
+        std::string name;
+        uint64_t count;
+        uint64_t sum; // 微秒
+        uint64_t max; // 微秒
+        std::vector<uint64_t> buckets;
+
+        // 百分位数（0~100），返回所在桶的上界（微秒）
+        uint64_t percentile(double p) const;
+    };
+
+    std::vector<HistogramSnapshot> histograms() const;
+    std::vector<std::pair<std::string, uint64_t>> counters() const;
+
+    // 所有指标的文本报告，每行一个指标
+    std::string report() const;
+
+    static const int kSubBucketBits = 4;
+    static const int kSubBucketCount = 1 << kSubBucketBits;
+    static const int kMaxExponent = 36; // 最大记录2^36微秒
+    static const int kBucketCount = kSubBucketCount + (kMaxExponent - kSubBucketBits) * kSubBucketCount;
+
+    // 值所在的桶和桶的上界
+    static int bucketOf(uint64_t micros);
+    static uint64_t upperBoundOf(int bucket);
+
+private:
+    Metrics() = default;
+
+    static const int kMaxHistograms = 128;
+    static const int kMaxCounters = 128;
+
+    // 一个线程中一个直方图的数据，只有所属线程写
+    struct HistogramData
+    {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+        std::atomic<uint64_t> buckets[kBucketCount];
+    };
+
+    // 一个线程的全部数据，线程退出后保留，数据仍计入合计
+    struct ThreadData
+    {
+        // 直方图在该线程第一次记录时才分配
+        std::atomic<HistogramData *> histograms[kMaxHistograms];
+        std::atomic<uint64_t> counters[kMaxCounters];
+    };
+
+    // 当前线程的数据，第一次调用时分配并登记
+    ThreadData *threadData();
+
+    // 保护下面的名字表和线程表
+    mutable std::mutex _mutex;
+    std::vector<std::string> _histogramNames;
+    std::vector<std::string> _counterNames;
+    std::vector<ThreadData *> _threads;
+};
+
+// 记录作用域耗时的计时器，析构时写入直方图
+class ScopedLatency
+{
+public:
+    explicit ScopedLatency(int id)
+        : _id(id), _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedLatency()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - _start;
+        Metrics::instance()->record(_id, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+
+    ScopedLatency(const ScopedLatency &) = delete;
+    ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+private:
+    int _id;
+    std::chrono::steady_clock::time_point _start;
+};
+
+// 记录所在作用域的耗时，直方图只在第一次执行到这里时注册
+#define METRICS_CONCAT_INNER(a, b) a##b
+#define METRICS_CONCAT(a, b) METRICS_CONCAT_INNER(a, b)
+#define METRICS_SCOPE(name)                                                                         \
+    static const int METRICS_CONCAT(metricsId_, __LINE__) = Metrics::instance()->histogram(name); \
+    ScopedLatency METRICS_CONCAT(metricsScope_, __LINE__)(METRICS_CONCAT(metricsId_, __LINE__))
+
+#endif // METRICS_H
@@ -0,0 +1,56 @@
+#ifndef STATSSERVER_H
+#define STATSSERVER_H
+
+#include <muduo/net/TcpServer.h>
+#include <muduo/net/EventLoopThread.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// 运行状态的查询端口，在自己的事件循环线程中服务，不占用聊天服务的IO线程
+// 支持两种请求，响应都是纯文本，每行“名字 值”，发送完就关闭连接：
+//   HTTP：GET /metrics（或 GET /），例如 curl http://ip:port/metrics
+//   纯文本：发送任意一行，例如 echo | nc ip port
+// 内容包括各模块登记的状态值（在线用户、队列长度、连接池等）、每秒速率和Metrics中的全部指标
+class StatsServer
+{
+public:
+    // 状态值回调，把“名字 值”追加到stats中，在查询端口的线程中调用，必须是线程安全的
+    using StatsCallback = std::function<void(std::vector<std::pair<std::string, long long>> &stats)>;
+
+    StatsServer(const InetAddress &listenAddr, const std::string &name);
+    ~StatsServer();
+
+    // 登记状态值回调，必须在start之前调用
+    void addStats(StatsCallback callback) { _callbacks.push_back(std::move(callback)); }
+
+    // 启动查询端口的事件循环线程，开始监听后才返回
+    void start();
+
+private:
+    // 每秒采样一次Metrics，算出各指标在最近一秒内的速率
+    void sample();
+
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time);
+
+    // 生成完整的文本报告
+    std::string report();
+
+    InetAddress _listenAddr;
+    std::string _name;
+    EventLoopThread _loopThread;
+    std::unique_ptr<TcpServer> _server;
+    std::vector<StatsCallback> _callbacks;
+
+    // 上一次采样的次数（直方图的记录次数和计数器的值）和算出的每秒速率，只在查询端口的线程中访问
+    std::vector<std::pair<std::string, unsigned long long>> _lastCounts;
+    std::vector<std::pair<std::string, double>> _rates;
+};
+
+#endif // STATSSERVER_H
@@ -2,6 +2,7 @@
 #define FRIENDMODEL_H
 
 #include "user.hpp"
+#include "db.h"
 #include <vector>
 using namespace std;
 
@@ -14,6 +15,8 @@ public:
 
     // 返回用户好友列表
     vector<User> query(int userId);
+    // 在调用方借出的连接上查询，一次登录的多个查询共用同一个连接
+    vector<User> query(MySQL &mysql, int userId);
 };
 
 #endif // FRIENDMODEL_H
\ No newline at end of file
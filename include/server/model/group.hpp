@@ -12,23 +12,27 @@ public:
     Group(int id = -1, string name = "", string desc = "")
         : _id(id),
           _desc(desc),
-          _name(name)
+          _name(name),
+          _memberCount(0)
     {
     }
 
     void setId(int id) { _id = id; }
     void setName(string name) { _name = name; }
     void setDesc(string desc) { _desc = desc; }
+    void setMemberCount(int count) { _memberCount = count; }
 
     int getId() { return _id; }
     string getName() { return _name; }
     string getDesc() { return _desc; }
+    int getMemberCount() { return _memberCount; }
     vector<GroupUser> &getUsers() { return _users; }
 
 private:
     int _id;
     string _name;
     string _desc;
+    int _memberCount;
     vector<GroupUser> _users;
 };
 
@@ -2,6 +2,7 @@
 #define GROUPMODEL_H
 
 #include "group.hpp"
+#include "db.h"
 #include <string>
 #include <vector>
 
@@ -12,10 +13,14 @@ public:
     bool createGroup(Group &group);
     // 加入群组
     void addGroup(int userid, int groupid, string role);
-    // 查询用户所在群组信息
+    // 查询用户所在群组信息和每个群组的成员数，不包含成员列表
     vector<Group> queryGroups(int userid);
-    // 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
-    vector<int> queryGroupUsers(int userid, int groupid);
+    // 在调用方借出的连接上查询，一次登录的多个查询共用同一个连接
+    vector<Group> queryGroups(MySQL &mysql, int userid);
+    // 根据指定的groupid查询群组全部成员的id列表，用于加载群组成员缓存
+    vector<int> queryGroupMembers(int groupid);
+    // 分页查询群组成员的详细信息，返回id大于afterUserid的前limit个成员
+    vector<GroupUser> queryMemberPage(int groupid, int afterUserid, int limit);
 
 };
 
@@ -0,0 +1,31 @@
+#ifndef LOGINMODEL_H
+#define LOGINMODEL_H
+
+#include "user.hpp"
+#include "group.hpp"
+#include "friendmodel.hpp"
+#include "groupmodel.hpp"
+#include <vector>
+using namespace std;
+
+// 登录时返回给客户端的数据快照
+struct LoginSnapshot
+{
+    vector<User> friends;
+    vector<Group> groups;
+};
+
+// 加载登录快照，所有查询都在同一个借出的连接上执行
+// 查询次数固定，和用户所在群组的数量无关
+class LoginModel
+{
+public:
+    // 加载userid的好友和群组，群组只带成员数，不带成员列表
+    LoginSnapshot load(int userid);
+
+private:
+    FriendModel _friendModel;
+    GroupModel _groupModel;
+};
+
+#endif // LOGINMODEL_H
@@ -1,22 +1,40 @@
 #ifndef OFFLINEMESSAGEMODEL_H
 #define OFFLINEMESSAGEMODEL_H
 
+#include "offlinestore.hpp"
+#include <memory>
 #include <string>
 #include <vector>
 using namespace std;
 
-// 提供离线消息表的操作接口方法
+// 提供离线消息的操作接口方法
+// 具体的存储由OfflineStore实现，默认存在MySQL的offlinemessage表中
 class OfflineMsgModel
 {
 public:
+    OfflineMsgModel();
+
+    // 更换离线消息的存储，只能在服务开始处理请求之前调用
+    void setStore(unique_ptr<OfflineStore> store);
+
     // 存储用户的离线消息
     void insert(int userId, string msg);
 
-    // 删除用户的离线消息
-    void remove(int userId);
+    // 批量存储多个用户的同一条离线消息（群消息）
+    void insert(const vector<int> &userIds, const string &msg);
+
+    // 删除用户已经发给客户端并被确认的离线消息ids
+    void remove(int userId, const vector<long long> &ids);
+
+    // 分页查询用户id大于afterId的离线消息，最多limit条
+    // 累计大小超过maxBytes时提前结束，但至少返回一条
+    vector<OfflineMessage> query(int userId, long long afterId, int limit, size_t maxBytes);
+
+    // 所有用户未确认的离线消息总数（可以是估计值），存储不支持时返回-1
+    long long backlog() { return _store->backlog(); }
 
-    // 查询用户的离线消息（可能有多个）
-    vector<string> query(int userId);
+private:
+    unique_ptr<OfflineStore> _store;
 };
 
-#endif // OFFLINEMESSAGEMODEL_H
\ No newline at end of file
+#endif // OFFLINEMESSAGEMODEL_H
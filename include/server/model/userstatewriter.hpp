@@ -0,0 +1,51 @@
+#ifndef USERSTATEWRITER_H
+#define USERSTATEWRITER_H
+
+#include <unordered_map>
+#include <condition_variable>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+// 用户状态的延迟写入器
+// 上线/下线只在内存中记下用户最新的状态，同一用户多次变化只保留最后一次
+// 后台线程定期（或积压过多时）把状态相同的用户合并成一条 update ... where id in (...)
+// 在线状态的读取由在线目录负责，user表的state字段只是最终一致的持久化副本
+// 写入失败（拿不到连接或语句执行失败）的用户放回积压，下一个间隔再写，期间有新状态的以新状态为准
+class UserStateWriter
+{
+public:
+    // interval是两次写入之间的最长间隔（毫秒），积压超过maxPending个用户时提前写入
+    UserStateWriter(int interval, size_t maxPending);
+    ~UserStateWriter();
+
+    UserStateWriter(const UserStateWriter &) = delete;
+    UserStateWriter &operator=(const UserStateWriter &) = delete;
+
+    // 记录用户的最新状态，不访问数据库
+    void setState(int userid, bool online);
+
+    // 写入所有积压的状态后停止后台线程，可以重复调用
+    void stop();
+
+private:
+    // 后台线程的主循环
+    void runInThread();
+    // 把一批状态写入数据库，写入成功的从pending中移除，剩下的是失败的
+    void flush(std::unordered_map<int, bool> &pending);
+    // 把ids的状态更新为state，每条语句最多kBatchSize个id，返回成功写入的id个数（从头开始）
+    size_t update(const char *state, const std::vector<int> &ids);
+
+    static const size_t kBatchSize = 1000;
+
+    int _interval;
+    size_t _maxPending;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::unordered_map<int, bool> _pending; // 用户id -> 最新状态（true为online）
+    bool _stop;
+    std::thread _thread;
+};
+
+#endif // USERSTATEWRITER_H
@@ -0,0 +1,17 @@
+#ifndef MYSQLOFFLINESTORE_H
+#define MYSQLOFFLINESTORE_H
+
+#include "offlinestore.hpp"
+
+// 存在MySQL offlinemessage表中的离线消息，id是表的自增主键
+class MySQLOfflineStore : public OfflineStore
+{
+public:
+    void insert(int userId, const string &msg) override;
+    void insert(const vector<int> &userIds, const string &msg) override;
+    void remove(int userId, const vector<long long> &ids) override;
+    vector<OfflineMessage> query(int userId, long long afterId, int limit, size_t maxBytes) override;
+    long long backlog() override;
+};
+
+#endif // MYSQLOFFLINESTORE_H
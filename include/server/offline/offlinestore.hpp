@@ -0,0 +1,39 @@
+#ifndef OFFLINESTORE_H
+#define OFFLINESTORE_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+// 一条离线消息，同一用户的消息按id递增，id只在该用户的范围内有意义
+struct OfflineMessage
+{
+    long long id;
+    string message;
+};
+
+// 离线消息存储接口，OfflineMsgModel通过它读写离线消息
+// 实现必须是线程安全的，多个业务线程会同时读写不同用户的离线消息
+class OfflineStore
+{
+public:
+    virtual ~OfflineStore() = default;
+
+    // 存储用户的离线消息
+    virtual void insert(int userId, const string &msg) = 0;
+    // 批量存储多个用户的同一条离线消息（群消息）
+    virtual void insert(const vector<int> &userIds, const string &msg) = 0;
+
+    // 删除用户的离线消息ids，即已经发给客户端并被确认的部分，ids按递增排列
+    // 只删除确实发出过的id：自增id在事务提交前就已分配，按范围删除会删掉晚提交、还没发出过的消息
+    virtual void remove(int userId, const vector<long long> &ids) = 0;
+
+    // 分页查询用户id大于afterId的离线消息，最多limit条
+    // 累计大小超过maxBytes时提前结束，但至少返回一条
+    virtual vector<OfflineMessage> query(int userId, long long afterId, int limit, size_t maxBytes) = 0;
+
+    // 所有用户未确认的离线消息总数（可以是估计值），不支持时返回-1
+    virtual long long backlog() { return -1; }
+};
+
+#endif // OFFLINESTORE_H
@@ -0,0 +1,57 @@
+#ifndef SEGMENTOFFLINESTORE_H
+#define SEGMENTOFFLINESTORE_H
+
+#include "offlinestore.hpp"
+#include <mutex>
+#include <stdint.h>
+
+// 基于本机文件的离线消息存储，每个用户一个只追加写的段文件，离线消息的读写不再占用MySQL
+// 文件格式：| 文件头 | 记录 | 记录 | ...
+//   文件头：| magic 4 | version 4 | base 8 | acked 8 |
+//   记录：  | id 8 | length 4 | 消息 |
+// 记录的id是它在该用户消息流中的逻辑偏移（base + 文件内偏移），已确认的前缀被压缩掉后base随之增大，id保持不变
+// 删除只是推进文件头中的acked，已确认的部分足够大时再重写文件；读取时用mmap映射整个文件
+// 注意：段文件只在本机可见，也没有跨进程的互斥，只适用于单台服务器的部署，
+// 集群中用户可能在另一台服务器上登录，取不到这里存的离线消息
+class SegmentOfflineStore : public OfflineStore
+{
+public:
+    // dir是存放段文件的目录，不存在时创建
+    explicit SegmentOfflineStore(const string &dir);
+
+    void insert(int userId, const string &msg) override;
+    void insert(const vector<int> &userIds, const string &msg) override;
+    void remove(int userId, const vector<long long> &ids) override;
+    vector<OfflineMessage> query(int userId, long long afterId, int limit, size_t maxBytes) override;
+
+private:
+    // 段文件的文件头
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        int64_t base;  // 文件内偏移0对应的逻辑偏移
+        int64_t acked; // 客户端已经确认的最大id
+    };
+
+    static const int kLockCount = 256; // 用户锁的条带数，必须是2的幂
+
+    // 用户的段文件：dir/<userId的低8位>/<userId>.seg，避免单个目录下文件过多
+    string shardOf(int userId) const;
+    string pathOf(int userId) const;
+    mutex &lockOf(int userId) { return _locks[static_cast<unsigned>(userId) & (kLockCount - 1)]; }
+
+    // 追加一条消息，调用方持有用户锁
+    void append(int userId, const string &msg);
+
+    // 在映射的文件中找到第一条id大于afterId的记录的文件内偏移
+    static size_t findStart(const char *data, size_t size, int64_t base, long long afterId);
+    // id正好是文件中一条完整记录的id时返回该记录之后的文件内偏移，否则返回0
+    static size_t recordEnd(const char *data, size_t size, int64_t base, long long id);
+
+    string _dir;
+    // 同一用户的读写、压缩互斥，不同用户之间按条带分散
+    mutex _locks[kLockCount];
+};
+
+#endif // SEGMENTOFFLINESTORE_H
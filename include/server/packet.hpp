@@ -0,0 +1,53 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include "json.hpp"
+#include <string>
+
+using namespace std;
+using json = nlohmann::json;
+
+// 连接上使用的编码格式，登录时协商
+enum WireFormat
+{
+    WIRE_JSON = 0,   // 纯json文本，便于调试
+    WIRE_BINARY = 1, // 固定二进制头部 + 载荷
+};
+
+// 解码后的一条消息，JSON和二进制两种编码统一成这个形式交给业务层
+// 二进制帧格式（网络字节序）：
+// | msgid(2) | flags(2) | sender(4) | target(4) | length(4) | payload(length) |
+// 载荷是消息的json文本，路由需要的字段都在头部，转发聊天消息时不需要解析载荷
+class Packet
+{
+public:
+    static const size_t kBinaryHeaderLen = 16;
+
+    Packet(int msgid = 0, int sender = 0, int target = 0, string payload = "")
+        : _msgid(msgid), _sender(sender), _target(target), _payload(std::move(payload)), _parsed(false)
+    {
+    }
+
+    // 由json对象生成消息，头部字段从json中提取
+    static Packet fromJson(json js);
+    // 由json文本生成消息，保留原始文本作为载荷，避免转发时重新dump
+    static Packet fromJson(json js, string payload);
+
+    int getMsgId() const { return _msgid; }
+    int getSender() const { return _sender; }
+    int getTarget() const { return _target; }
+    const string &getPayload() const { return _payload; }
+
+    // 载荷对应的json对象，二进制消息在第一次访问时才解析
+    json &body();
+
+private:
+    int _msgid;
+    int _sender; // 发送方用户id，没有时为0
+    int _target; // 接收方用户id或群组id，没有时为0
+    string _payload;
+    json _body;
+    bool _parsed;
+};
+
+#endif // PACKET_H
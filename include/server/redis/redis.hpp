@@ -2,45 +2,163 @@
 #define REDIS_H
 
 #include <hiredis/hiredis.h>
-#include <thread>
+#include <hiredis/async.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <vector>
+#include <string>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <set>
 
 using namespace std;
+using namespace muduo::net;
 using redis_handler = function<void(int, string)>;
+using redis_control_handler = function<void(string, string)>;
 
+// 基于hiredis异步接口的Redis客户端，由独立的muduo事件循环驱动
+// 所有命令都投递到Redis的事件循环线程中执行，任意线程调用都不会阻塞，也不需要额外加锁
+// 同一上下文上的命令由hiredis在一次写事件中批量发出，天然形成流水线
+// PUBLISH额外经过批处理：攒够一定数量或等待一个很短的窗口后一次性写出
+// 连接断开后按退避间隔自动重连，重连后重新验证密码并重新订阅之前订阅的全部通道
 class Redis
 {
 public:
+    // 发布结果的回调，在Redis的事件循环中执行
+    // ok表示命令执行成功，receivers是收到消息的订阅者数量，为0说明对端已经不在订阅
+    using PublishCallback = function<void(bool ok, long long receivers)>;
+
     Redis();
     ~Redis();
 
-    // 连接Redis服务器
-    bool connect();
+    // 连接Redis服务器，等待连接和密码验证完成
+    bool connect(const string &host, int port, const string &password);
+
+    // 两个上下文是否都已连接，断线重连期间为false
+    bool connected() const { return _connectedContexts == 2; }
 
-    // 向Redis指定的通道channel发布消息
+    // 向Redis指定的通道channel发布消息，只投递命令不等待结果
     bool publish(int channel, string message);
+    bool publish(const string &channel, const string &message);
+    // 消息以共享缓冲区传递，同一帧发布到多个通道时不必逐个拷贝
+    bool publish(int channel, shared_ptr<const string> message, PublishCallback callback = PublishCallback());
+    bool publish(const string &channel, shared_ptr<const string> message, PublishCallback callback = PublishCallback());
+
+    // 设置发布批处理的参数：攒够maxCount条立即写出，否则最多等待window秒
+    void setPublishBatch(size_t maxCount, double window);
+    // 等待写出的PUBLISH条数
+    size_t pendingPublishes();
 
     // 向Redis指定的通道subscribe订阅消息
     bool subscribe(int channel);
+    bool subscribe(const string &channel);
 
     // 取消订阅
     bool unsubscribe(int channel);
 
-    // 独立线程中接收订阅通道的消息
-    void observer_channel_message();
+    // 哈希表操作：设置/删除字段只投递命令，读取全部字段会等待结果（只在启动阶段使用）
+    bool hset(const string &key, const string &field, const string &value);
+    // 仅当字段的当前值等于value时才删除，避免删掉别的服务器刚写入的值
+    bool hdelIfEqual(const string &key, const string &field, const string &value);
+    bool hgetall(const string &key, vector<pair<string, string>> &entries);
+
+    // 等待此前投递的命令（包括还在批次中的PUBLISH）都执行完成，不能在Redis事件循环线程中调用
+    bool sync();
 
     // 初始化向业务层上报通道消息的回调对象
     void init_notify_handler(redis_handler handler);
 
+    // 初始化上报控制通道（非用户id命名的通道）消息的回调对象
+    void init_control_handler(redis_control_handler handler);
+
 private:
-    // hiredis同步上下文对象，负责publish消息
-    redisContext *_publish_context;
+    // 命令结果的回调，连接断开时reply为nullptr
+    using ReplyCallback = function<void(redisReply *)>;
+
+    // 等待批量写出的PUBLISH命令
+    struct PendingPublish
+    {
+        string channel;
+        shared_ptr<const string> message;
+        PublishCallback callback;
+        chrono::steady_clock::time_point start; // 调用publish的时间
+    };
+
+    // 在Redis事件循环中把攒下的PUBLISH一次性追加到上下文，由同一次写事件发出
+    void flushPublishes();
+
+    // 在Redis事件循环中创建异步上下文，并挂到muduo的Channel上
+    redisAsyncContext *connectContext();
+
+    // 上下文断开或连接失败后置空对应的指针并安排重连，主动释放的上下文不重连
+    void lostContext(const redisAsyncContext *ac);
+    // 等待退避间隔后重连，每次失败间隔翻倍
+    void scheduleReconnect(redisAsyncContext *Redis::*context);
+    // 重新创建上下文，验证密码，订阅上下文还要重新订阅全部通道
+    void reconnect(redisAsyncContext *Redis::*context);
+
+    // 在Redis事件循环中向订阅上下文发送SUBSCRIBE
+    void sendSubscribe(const vector<string> &channels);
+
+    // 在Redis事件循环中异步执行命令，args是命令名和参数
+    // metric是记录命令往返耗时（从调用到收到回复）的直方图编号，-1表示不记录
+    bool command(redisAsyncContext *Redis::*context, vector<string> args, ReplyCallback callback = ReplyCallback(), int metric = -1);
+    // 执行命令并等待结果，不能在Redis事件循环线程中调用
+    bool commandSync(redisAsyncContext *Redis::*context, vector<string> args, ReplyCallback callback, int metric = -1);
+
+    // hiredis的回调函数
+    static void replyCallback(redisAsyncContext *ac, void *reply, void *privdata);
+    static void subscribeCallback(redisAsyncContext *ac, void *reply, void *privdata);
+    static void connectCallback(const redisAsyncContext *ac, int status);
+    static void disconnectCallback(const redisAsyncContext *ac, int status);
+
+    // 指标编号：各命令的往返耗时、发布消息在批次中的等待时间、批次数和消息数、收到的通道消息数
+    int _hsetMetric;
+    int _hdelMetric;
+    int _hgetallMetric;
+    int _publishMetric;
+    int _publishQueueMetric;
+    int _publishBatchCounter;
+    int _publishMessageCounter;
+    int _receivedMessageCounter;
+
+    // Redis服务器地址和密码，重连时使用
+    string _host;
+    int _port;
+    string _password;
+
+    // 驱动hiredis异步上下文的事件循环线程
+    EventLoopThread _loopThread;
+    EventLoop *_loop;
+
+    // hiredis异步上下文对象，负责publish消息和其他普通命令
+    redisAsyncContext *_publish_context;
 
     // 负责subscribe消息
-    redisContext *_subscribe_context;
+    redisAsyncContext *_subscribe_context;
+
+    // 已连接的上下文数量
+    atomic_int _connectedContexts;
+    // 以下只在Redis事件循环中访问：是否断线重连、下一次重连的等待间隔（秒）、已订阅的通道
+    bool _reconnect;
+    double _reconnectDelay;
+    set<string> _channels;
+
+    // 发布批处理的参数和待写出的命令
+    size_t _batchMaxCount;
+    double _batchWindow;
+    mutex _pendingMutex;
+    vector<PendingPublish> _pendingPublishes;
+    bool _flushScheduled;
 
     // 回调操作，收到消息给service上报
     redis_handler _notify_message_handler;
+
+    // 回调操作，收到控制通道的消息给service上报
+    redis_control_handler _notify_control_handler;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,35 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "packet.hpp"
+#include <muduo/net/TcpConnection.h>
+#include <boost/any.hpp>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+using namespace muduo::net;
+
+// 每条连接上的会话状态，连接建立时由ChatServer挂到TcpConnection的context上
+struct Session
+{
+    // 当前连接使用的编码格式，登录协商后可能由业务线程修改
+    std::atomic<int> format{WIRE_JSON};
+    // 在该连接上登录的用户id，未登录为-1，断开连接时据此直接找到用户
+    std::atomic<int> userid{-1};
+    // 该连接上最近一条消息投递到的业务线程key，只在连接所在的IO线程中访问
+    // 登录消息还在排队时userid仍为-1，断开连接的处理按它投递，保证排在登录之后
+    size_t lastKey = 0;
+    // 上一次发给该连接的离线消息id，只在该用户的业务线程中访问，客户端确认后只删除这些消息
+    std::vector<long long> offlineIds;
+};
+
+using SessionPtr = std::shared_ptr<Session>;
+
+// 取出连接上的会话状态
+inline const SessionPtr &getSession(const TcpConnectionPtr &conn)
+{
+    return boost::any_cast<const SessionPtr &>(conn->getContext());
+}
+
+#endif // SESSION_H
@@ -0,0 +1,56 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <functional>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+
+// 业务线程池，把会阻塞的业务处理（访问MySQL/Redis）从muduo的IO线程中剥离
+// 每个工作线程有自己的有界队列，按key把任务固定投递给同一个线程，保证同一用户的消息按顺序处理
+class WorkerPool
+{
+public:
+    using Task = std::function<void()>;
+
+    WorkerPool(int threadNum, size_t queueCapacity);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // 启动工作线程
+    void start();
+    // 处理完已投递的任务后停止工作线程
+    void stop();
+
+    // 按key投递任务，队列满时阻塞等待，对IO线程形成背压
+    void submit(size_t key, Task task);
+
+    int threadNum() const { return static_cast<int>(_workers.size()); }
+    // 所有队列中等待处理的任务数
+    size_t queueSize() const;
+
+private:
+    struct Worker
+    {
+        mutable std::mutex mutex;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    // 工作线程的主循环
+    void runInThread(Worker *worker);
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    size_t _queueCapacity; // 每个工作线程队列的容量
+    std::atomic_bool _running;
+};
+
+#endif // WORKERPOOL_H
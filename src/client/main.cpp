@@ -39,6 +39,8 @@ atomic_bool g_isLoginSuccess{false};
 
 // 接收线程
 void readTaskHandler(int clientfd);
+// 给消息加上4字节长度头后发送
+int sendMessage(int clientfd, const string &msg);
 // 获取系统时间（聊天信息需要添加时间信息）
 string getCurrentTime();
 // 主聊天页面程序
@@ -126,7 +128,7 @@ int main(int argc, char **argv)
 
             g_isLoginSuccess = false;
 
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendMessage(clientfd, request);
             if (len == -1)
             {
                 cerr << "send login msg error:" << request << endl;
@@ -157,7 +159,7 @@ int main(int argc, char **argv)
             js["password"] = pwd;
             string request = js.dump();
 
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendMessage(clientfd, request);
             if (len == -1)
             {
                 cerr << "send reg msg error:" << request << endl;
@@ -240,18 +242,8 @@ void doLoginResponse(json &responsejs)
                 group.setId(grpjs["id"].get<int>());
                 group.setName(grpjs["groupname"]);
                 group.setDesc(grpjs["groupdesc"]);
-
-                vector<string> vec2 = grpjs["users"];
-                for (string &userstr : vec2)
-                {
-                    GroupUser user;
-                    json js = json::parse(userstr);
-                    user.setId(js["id"].get<int>());
-                    user.setName(js["name"]);
-                    user.setState(js["state"]);
-                    user.setRole(js["role"]);
-                    group.getUsers().push_back(user);
-                }
+                // 登录响应只带成员数，成员列表用groupmembers命令查询
+                group.setMemberCount(grpjs["count"].get<int>());
 
                 g_currentUserGroupList.push_back(group);
             }
@@ -260,77 +252,185 @@ void doLoginResponse(json &responsejs)
         // 显示登录用户的基本信息
         showCurrentUserData();
 
-        // 显示当前用户的离线消息  个人聊天信息或者群组消息
-        if (responsejs.contains("offlinemsg"))
+        g_isLoginSuccess = true;
+    }
+}
+
+// 显示一条聊天消息  个人聊天信息或者群组消息
+void showChatMessage(json &js)
+{
+    // time + [id] + name + " said: " + xxx
+    if (ONE_CHAT_MSG == js["msgid"].get<int>())
+    {
+        cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+             << " said: " << js["msg"].get<string>() << endl;
+    }
+    else
+    {
+        cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+             << " said: " << js["msg"].get<string>() << endl;
+    }
+}
+
+// 拉取下一页离线消息，同时确认ack及之前的离线消息已经处理完
+void requestOfflineMessages(int clientfd, long long ack)
+{
+    json js;
+    js["msgid"] = OFFLINE_MSG;
+    js["id"] = g_currentUser.getId();
+    js["ack"] = ack;
+    string buffer = js.dump();
+
+    int len = sendMessage(clientfd, buffer);
+    if (-1 == len)
+    {
+        cerr << "send offline msg error -> " << buffer << endl;
+    }
+}
+
+// 处理离线消息分页的响应，显示完一页后确认并拉取下一页，空页表示已经取完
+void doOfflineResponse(int clientfd, json &responsejs)
+{
+    vector<string> vec = responsejs["msgs"];
+    if (vec.empty())
+    {
+        return;
+    }
+
+    for (string &str : vec)
+    {
+        json js = json::parse(str);
+        showChatMessage(js);
+    }
+    requestOfflineMessages(clientfd, responsejs["cursor"].get<long long>());
+}
+
+// 请求群组成员的一页，cursor是上一页最后一个成员id
+void requestGroupMembers(int clientfd, int groupid, int cursor)
+{
+    json js;
+    js["msgid"] = GROUP_MEMBERS_MSG;
+    js["id"] = g_currentUser.getId();
+    js["groupid"] = groupid;
+    js["cursor"] = cursor;
+    string buffer = js.dump();
+
+    int len = sendMessage(clientfd, buffer);
+    if (-1 == len)
+    {
+        cerr << "send groupmembers msg error -> " << buffer << endl;
+    }
+}
+
+// 处理群组成员分页的响应，还有下一页时继续请求
+void doGroupMembersResponse(int clientfd, json &responsejs)
+{
+    if (0 != responsejs["errno"].get<int>())
+    {
+        cerr << responsejs["errmsg"] << endl;
+        return;
+    }
+
+    vector<string> vec = responsejs["users"];
+    for (string &userstr : vec)
+    {
+        json js = json::parse(userstr);
+        cout << js["id"] << " " << js["name"].get<string>() << " " << js["state"].get<string>()
+             << " " << js["role"].get<string>() << endl;
+    }
+
+    if (responsejs["more"].get<bool>())
+    {
+        requestGroupMembers(clientfd, responsejs["groupid"].get<int>(), responsejs["cursor"].get<int>());
+    }
+}
+
+// 处理服务器发来的一条完整消息
+void handleMessage(int clientfd, json &js)
+{
+    int msgtype = js["msgid"].get<int>();
+    if (ONE_CHAT_MSG == msgtype || GROUP_CHAT_MSG == msgtype)
+    {
+        showChatMessage(js);
+        return;
+    }
+
+    if (LOGIN_MSG_ACK == msgtype)
+    {
+        doLoginResponse(js); // 处理登录响应的业务逻辑
+        sem_post(&rwsem);    // 通知主线程，登录结果处理完成
+        if (g_isLoginSuccess)
         {
-            vector<string> vec = responsejs["offlinemsg"];
-            for (string &str : vec)
-            {
-                json js = json::parse(str);
-                // time + [id] + name + " said: " + xxx
-                if (ONE_CHAT_MSG == js["msgid"].get<int>())
-                {
-                    cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                         << " said: " << js["msg"].get<string>() << endl;
-                }
-                else
-                {
-                    cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                         << " said: " << js["msg"].get<string>() << endl;
-                }
-            }
+            // 登录成功后从头拉取离线消息
+            requestOfflineMessages(clientfd, 0);
         }
+        return;
+    }
 
-        g_isLoginSuccess = true;
+    if (OFFLINE_MSG_ACK == msgtype)
+    {
+        doOfflineResponse(clientfd, js);
+        return;
+    }
+
+    if (REGISTER_MSG_ACK == msgtype)
+    {
+        doRegResponse(js);
+        sem_post(&rwsem); // 通知主线程，注册结果处理完成
+        return;
+    }
+
+    if (GROUP_MEMBERS_MSG_ACK == msgtype)
+    {
+        doGroupMembersResponse(clientfd, js);
+        return;
     }
 }
 
 // 子线程 - 接收线程
 void readTaskHandler(int clientfd)
 {
+    // 接收缓冲区，一次recv可能收到多条消息，也可能不足一条
+    string inbuf;
     for (;;)
     {
-        char buffer[1024] = {0};
-        int len = recv(clientfd, buffer, 1024, 0); // 阻塞了
+        char buffer[4096] = {0};
+        int len = recv(clientfd, buffer, sizeof(buffer), 0); // 阻塞了
         if (-1 == len || 0 == len)
         {
             close(clientfd);
             exit(-1);
         }
+        inbuf.append(buffer, len);
 
-        // 接收ChatServer转发的数据，反序列化生成json数据对象
-        json js = json::parse(buffer);
-        int msgtype = js["msgid"].get<int>();
-        if (ONE_CHAT_MSG == msgtype)
+        // 按4字节长度头切出所有完整的消息
+        while (inbuf.size() >= sizeof(uint32_t))
         {
-            cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                 << " said: " << js["msg"].get<string>() << endl;
-            continue;
-        }
-
-        if (GROUP_CHAT_MSG == msgtype)
-        {
-            cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                 << " said: " << js["msg"].get<string>() << endl;
-            continue;
-        }
-
-        if (LOGIN_MSG_ACK == msgtype)
-        {
-            doLoginResponse(js); // 处理登录响应的业务逻辑
-            sem_post(&rwsem);    // 通知主线程，登录结果处理完成
-            continue;
-        }
+            uint32_t be32 = 0;
+            memcpy(&be32, inbuf.data(), sizeof(be32));
+            size_t msglen = ntohl(be32);
+            if (inbuf.size() < sizeof(uint32_t) + msglen)
+            {
+                break;
+            }
 
-        if (REGISTER_MSG_ACK == msgtype)
-        {
-            doRegResponse(js);
-            sem_post(&rwsem); // 通知主线程，注册结果处理完成
-            continue;
+            // 接收ChatServer转发的数据，反序列化生成json数据对象
+            json js = json::parse(inbuf.begin() + sizeof(uint32_t), inbuf.begin() + sizeof(uint32_t) + msglen);
+            inbuf.erase(0, sizeof(uint32_t) + msglen);
+            handleMessage(clientfd, js);
         }
     }
 }
 
+// 给消息加上4字节长度头后发送
+int sendMessage(int clientfd, const string &msg)
+{
+    uint32_t be32 = htonl(static_cast<uint32_t>(msg.size()));
+    string frame(reinterpret_cast<const char *>(&be32), sizeof(be32));
+    frame += msg;
+    return send(clientfd, frame.data(), frame.size(), 0);
+}
+
 // 显示当前登录成功用户的基本信息
 void showCurrentUserData()
 {
@@ -349,12 +449,8 @@ void showCurrentUserData()
     {
         for (Group &group : g_currentUserGroupList)
         {
-            cout << group.getId() << " " << group.getName() << " " << group.getDesc() << endl;
-            for (GroupUser &user : group.getUsers())
-            {
-                cout << user.getId() << " " << user.getName() << " " << user.getState()
-                     << " " << user.getRole() << endl;
-            }
+            cout << group.getId() << " " << group.getName() << " " << group.getDesc()
+                 << " (" << group.getMemberCount() << " members)" << endl;
         }
     }
     cout << "======================================================" << endl;
@@ -372,6 +468,8 @@ void creategroup(int, string);
 void addgroup(int, string);
 // "groupchat" command handler
 void groupchat(int, string);
+// "groupmembers" command handler
+void groupmembers(int, string);
 // "loginout" command handler
 void loginout(int, string);
 
@@ -383,6 +481,7 @@ unordered_map<string, string> commandMap = {
     {"creategroup", "创建群组，格式creategroup:groupname:groupdesc"},
     {"addgroup", "加入群组，格式addgroup:groupid"},
     {"groupchat", "群聊，格式groupchat:groupid:message"},
+    {"groupmembers", "查看群组成员，格式groupmembers:groupid"},
     {"loginout", "注销，格式loginout"}};
 
 // 注册系统支持的客户端命令处理
@@ -393,6 +492,7 @@ unordered_map<string, function<void(int, string)>> commandHandlerMap = {
     {"creategroup", creategroup},
     {"addgroup", addgroup},
     {"groupchat", groupchat},
+    {"groupmembers", groupmembers},
     {"loginout", loginout}};
 
 // 主聊天页面程序
@@ -448,7 +548,7 @@ void addfriend(int clientfd, string str)
     js["friendid"] = friendid;
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send addfriend msg error -> " << buffer << endl;
@@ -476,7 +576,7 @@ void chat(int clientfd, string str)
     js["time"] = getCurrentTime();
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send chat msg error -> " << buffer << endl;
@@ -502,7 +602,7 @@ void creategroup(int clientfd, string str)
     js["groupdesc"] = groupdesc;
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send creategroup msg error -> " << buffer << endl;
@@ -518,7 +618,7 @@ void addgroup(int clientfd, string str)
     js["groupid"] = groupid;
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send addgroup msg error -> " << buffer << endl;
@@ -546,12 +646,18 @@ void groupchat(int clientfd, string str)
     js["time"] = getCurrentTime();
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send groupchat msg error -> " << buffer << endl;
     }
 }
+// "groupmembers" command handler   groupid
+void groupmembers(int clientfd, string str)
+{
+    // 从第一页开始，后续页由接收线程收到响应后继续请求
+    requestGroupMembers(clientfd, atoi(str.c_str()), 0);
+}
 // "loginout" command handler
 void loginout(int clientfd, string)
 {
@@ -560,7 +666,7 @@ void loginout(int clientfd, string)
     js["id"] = g_currentUser.getId();
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMessage(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send loginout msg error -> " << buffer << endl;
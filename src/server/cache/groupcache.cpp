@@ -0,0 +1,53 @@
+#include "groupcache.hpp"
+#include <algorithm>
+#include <mutex>
+
+GroupCache::GroupCache(const Loader &loader, size_t capacity)
+    : _loader(loader), _capacity(capacity), _generation(0)
+{
+}
+
+// 获取群组的全部成员，未缓存时加载
+GroupCache::MemberList GroupCache::getMembers(int groupid)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        auto it = _groups.find(groupid);
+        if (it != _groups.end())
+        {
+            return it->second;
+        }
+    }
+
+    // 在锁外访问数据库，不阻塞其他群组的读取
+    unsigned long generation = _generation;
+    std::vector<int> members = _loader(groupid);
+    std::sort(members.begin(), members.end());
+    MemberList list = std::make_shared<const std::vector<int>>(std::move(members));
+
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    if (generation == _generation)
+    {
+        // 超过容量时随便淘汰一个，被淘汰的群组下次访问会重新加载
+        if (_groups.size() >= _capacity && !_groups.empty())
+        {
+            _groups.erase(_groups.begin());
+        }
+        _groups[groupid] = list;
+    }
+    return list;
+}
+
+// 群组成员变化后使缓存失效
+void GroupCache::invalidate(int groupid)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    ++_generation;
+    _groups.erase(groupid);
+}
+
+size_t GroupCache::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _groups.size();
+}
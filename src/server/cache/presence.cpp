@@ -0,0 +1,82 @@
+#include "presence.hpp"
+#include <mutex>
+
+PresenceDirectory::PresenceDirectory()
+    : _size(0)
+{
+}
+
+// 用户在node上上线
+void PresenceDirectory::insert(int userid, const std::string &node)
+{
+    int index = internNode(node);
+    Shard &shard = shardOf(userid);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.users.insert_or_assign(userid, index).second)
+    {
+        ++_size;
+    }
+}
+
+// 用户从node下线
+// 上下线通知可能乱序到达，只有记录的服务器和下线的服务器一致时才删除
+void PresenceDirectory::erase(int userid, const std::string &node)
+{
+    int index = internNode(node);
+    Shard &shard = shardOf(userid);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.users.find(userid);
+    if (it != shard.users.end() && it->second == index)
+    {
+        shard.users.erase(it);
+        --_size;
+    }
+}
+
+// 用户是否在线
+bool PresenceDirectory::contains(int userid) const
+{
+    const Shard &shard = shardOf(userid);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    return shard.users.count(userid) > 0;
+}
+
+// 用户所在的服务器
+std::string PresenceDirectory::nodeOf(int userid) const
+{
+    int index = -1;
+    {
+        const Shard &shard = shardOf(userid);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.users.find(userid);
+        if (it == shard.users.end())
+        {
+            return std::string();
+        }
+        index = it->second;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(_nodeMutex);
+    return _nodes[index];
+}
+
+// 取得服务器名的编号，第一次出现时分配
+int PresenceDirectory::internNode(const std::string &node)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(_nodeMutex);
+        auto it = _nodeIndex.find(node);
+        if (it != _nodeIndex.end())
+        {
+            return it->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(_nodeMutex);
+    auto result = _nodeIndex.emplace(node, static_cast<int>(_nodes.size()));
+    if (result.second)
+    {
+        _nodes.push_back(node);
+    }
+    return result.first->second;
+}
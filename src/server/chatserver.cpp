@@ -1,59 +1,244 @@
 #include "chatserver.hpp"
-#include "json.hpp"
 #include "chatservice.hpp"
+#include "session.hpp"
+#include "metrics.hpp"
+#include <muduo/base/Logging.h>
 #include <functional>
 #include <string>
+#include <thread>
+#include <algorithm>
+#include <future>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
 
 using namespace std;
 using namespace placeholders;
-using json = nlohmann::json;
 
 // 初始化聊天服务器对象
 ChatServer::ChatServer(EventLoop *loop,
                        const InetAddress &listenAddr,
-                       const string &nameArg)
-    : _server(loop, listenAddr, nameArg), _loop(loop)
+                       const string &nameArg,
+                       int workerThreads,
+                       size_t queueCapacity,
+                       int ioThreads,
+                       bool pinCpu,
+                       bool reusePort,
+                       int32_t maxMessageLen)
+    : _loop(loop), _listenAddr(listenAddr), _name(nameArg),
+      _codec(std::bind(&ChatServer::onMessage, this, _1, _2, _3), maxMessageLen),
+      _workers(workerThreads, queueCapacity),
+      _ioThreads(ioThreads > 0 ? ioThreads : std::max(1u, std::thread::hardware_concurrency())),
+      _pinCpu(pinCpu),
+      _reusePort(reusePort),
+      _nextCpu(0),
+      _connectedCounter(Metrics::instance()->counter("conn.connected")),
+      _disconnectedCounter(Metrics::instance()->counter("conn.disconnected")),
+      _messageCounter(Metrics::instance()->counter("messages.received")),
+      _queueWaitMetric(Metrics::instance()->histogram("worker.queue_wait")),
+      _closeMetric(Metrics::instance()->histogram("conn.close"))
 {
-    // 注册连接事件的回调函数
-    _server.setConnectionCallback(std::bind(&ChatServer::onConnection, this, _1));
+    // Redis事件循环中收到的消息需要访问数据库时，也交给业务线程处理
+    ChatService::instance()->setWorkerPool(&_workers);
 
-    // 注册消息事件的回调函数
-    _server.setMessageCallback(std::bind(&ChatServer::onMessage, this, _1, _2, _3));
+    if (_reusePort)
+    {
+        // 主循环自己也监听并处理连接，其余的IO线程在start中创建
+        addServer(_loop, TcpServer::kReusePort);
+    }
+    else
+    {
+        // 主循环只负责accept，设置subLoop线程数量
+        TcpServer *server = addServer(_loop, TcpServer::kNoReusePort);
+        server->setThreadNum(_ioThreads);
+        server->setThreadInitCallback(std::bind(&ChatServer::onThreadInit, this, _1));
+    }
+}
 
-    // 设置subLoop线程数量
-    _server.setThreadNum(4);
+// TcpServer只能在自己的loop线程中析构，reusePort模式下其余IO线程上的TcpServer交给各自的线程销毁
+ChatServer::~ChatServer()
+{
+    for (size_t i = 1; i < _servers.size(); ++i)
+    {
+        TcpServer *server = _servers[i].release();
+        std::promise<void> destroyed;
+        server->getLoop()->runInLoop([server, &destroyed]()
+                                     {
+            delete server;
+            destroyed.set_value(); });
+        destroyed.get_future().wait();
+    }
 }
 
 // 启动服务
 void ChatServer::start()
 {
-    _server.start();
+    _workers.start();
+
+    if (_reusePort)
+    {
+        // 主循环算作第一个IO线程，启动其余的IO线程，每个线程一个监听同一端口的TcpServer
+        if (_pinCpu)
+        {
+            onThreadInit(_loop);
+        }
+        for (int i = 1; i < _ioThreads; ++i)
+        {
+            _loopThreads.emplace_back(new EventLoopThread(std::bind(&ChatServer::onThreadInit, this, _1),
+                                                          _name + "-io" + to_string(i)));
+            EventLoop *ioLoop = _loopThreads.back()->startLoop();
+            // TcpServer只能在自己的loop线程中启动，在IO线程中创建并开始监听，等它监听后再启动下一个
+            std::promise<void> listening;
+            ioLoop->runInLoop([this, ioLoop, &listening]()
+                              {
+                addServer(ioLoop, TcpServer::kReusePort)->start();
+                listening.set_value(); });
+            listening.get_future().wait();
+        }
+    }
+
+    // 主循环上的TcpServer，start在主线程（即主循环的线程）中调用
+    _servers.front()->start();
+    LOG_INFO << _name << " listening on " << _listenAddr.toIpPort() << " with " << _ioThreads << " io threads"
+             << (_reusePort ? " (reuseport)" : "") << (_pinCpu ? " (pinned)" : "");
+}
+
+// 在loop上创建一个监听端口的TcpServer，注册好回调
+TcpServer *ChatServer::addServer(EventLoop *loop, TcpServer::Option option)
+{
+    // 每个TcpServer的名字不同，连接名（名字 + 地址 + 序号）在整个进程中也就不会重复
+    string name = _servers.empty() ? _name : _name + "-" + to_string(_servers.size());
+    TcpServer *server = new TcpServer(loop, _listenAddr, name, option);
+    _servers.emplace_back(server);
+
+    // 注册连接事件的回调函数
+    server->setConnectionCallback(std::bind(&ChatServer::onConnection, this, _1));
+
+    // 注册消息事件的回调函数，先由编解码器分帧，再回调onMessage
+    server->setMessageCallback(std::bind(&ChatCodec::onMessage, &_codec, _1, _2, _3));
+    return server;
+}
+
+// IO线程启动时的回调，开启绑核时按启动顺序把线程绑定到各个CPU核上
+void ChatServer::onThreadInit(EventLoop *loop)
+{
+    if (!_pinCpu)
+    {
+        return;
+    }
+    int cpus = std::max(1u, std::thread::hardware_concurrency());
+    int cpu = _nextCpu++ % cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+    {
+        LOG_ERROR << "pin io thread to cpu " << cpu << " failed: " << strerror(err);
+    }
 }
 
 // 连接相关信息的回调函数
 void ChatServer::onConnection(const TcpConnectionPtr &conn)
 {
+    // 新连接建立，挂上会话状态，默认使用json编码
+    if (conn->connected())
+    {
+        SessionPtr session = std::make_shared<Session>();
+        session->lastKey = std::hash<TcpConnection *>()(conn.get());
+        conn->setContext(session);
+        Metrics::instance()->add(_connectedCounter);
+        countConnection(conn->getLoop(), 1);
+    }
     // 客户端断开连接
-    if (!conn->connected())
+    else
     {
-        ChatService::instance()->clientCloseExceptionHandler(conn);
+        // 下线处理也交给该用户的业务线程，排在该用户已收到的消息之后
+        Metrics::instance()->add(_disconnectedCounter);
+        countConnection(conn->getLoop(), -1);
+        const SessionPtr &session = getSession(conn);
+        size_t key = session->userid == -1 ? session->lastKey : dispatchKey(conn, -1);
+        _workers.submit(key, [this, conn]()
+                        {
+            ScopedLatency latency(_closeMetric);
+            ChatService::instance()->clientCloseExceptionHandler(conn); });
         conn->shutdown();
     }
 }
 
-// 读写事件相关信息的回调函数
+// 累计IO线程loop上的连接数
+void ChatServer::countConnection(EventLoop *loop, int delta)
+{
+    lock_guard<mutex> lock(_loopMutex);
+    for (auto &loopConnection : _loopConnections)
+    {
+        if (loopConnection.first == loop)
+        {
+            loopConnection.second += delta;
+            return;
+        }
+    }
+    _loopConnections.emplace_back(loop, delta);
+}
+
+// 网络模块的运行状态，由查询端口的线程调用
+void ChatServer::stats(vector<pair<string, long long>> &stats)
+{
+    long long total = 0;
+    {
+        lock_guard<mutex> lock(_loopMutex);
+        for (size_t i = 0; i < _loopConnections.size(); ++i)
+        {
+            stats.emplace_back("conn.loop." + to_string(i), _loopConnections[i].second);
+            total += _loopConnections[i].second;
+        }
+    }
+    stats.emplace_back("conn.total", total);
+    stats.emplace_back("worker.queue", _workers.queueSize());
+}
+
+// 编解码器切出一条完整消息后的回调函数，把消息交给业务线程处理
 void ChatServer::onMessage(const TcpConnectionPtr &conn,
-                           Buffer *buffer,
+                           Packet &packet,
                            Timestamp time)
 {
-    string buf = buffer->retrieveAllAsString();
-    // 数据的反序列化
-    json js = json::parse(buf);
+    Metrics::instance()->add(_messageCounter);
+    // 业务处理器中的响应直接调用TcpConnection::send，muduo会把发送操作转回连接所在的IO线程
+    size_t key = dispatchKey(conn, packet.getSender());
+    getSession(conn)->lastKey = key;
+    _workers.submit(key,
+                    [this, conn, packet = std::move(packet), time]() mutable
+                    { dispatch(conn, packet, time); });
+}
+
+// 选择业务线程的key：登录后按会话上的用户id，登录消息按其中的用户id，未登录的连接按连接本身
+size_t ChatServer::dispatchKey(const TcpConnectionPtr &conn, int sender)
+{
+    int userid = getSession(conn)->userid;
+    if (userid == -1)
+    {
+        userid = sender;
+    }
+    return userid > 0 ? static_cast<size_t>(userid) : std::hash<TcpConnection *>()(conn.get());
+}
+
+// 在业务线程中调用消息对应的处理器
+void ChatServer::dispatch(const TcpConnectionPtr &conn,
+                          Packet &packet,
+                          Timestamp time)
+{
+    // time是IO线程读到这条消息的时间，到这里的间隔就是在业务线程队列中的等待时间
+    Metrics::instance()->record(_queueWaitMetric, std::max<int64_t>(0, Timestamp::now().microSecondsSinceEpoch() - time.microSecondsSinceEpoch()));
 
     // 目的：完全解耦网络模块和业务模块的代码，避免在网络模块中直接调用业务模块的相关方法
-    // 通过js["msgid"]来获取不同的业务处理器（事先绑定的回调方法）
-    // js["msgid"].get<int>() 将js["msgid"]对应的值强制转换成int
-    auto msgHandler = ChatService::instance()->getHandler(js["msgid"].get<int>());
-    // 回调消息绑定好的事件处理器，来执行相应的业务处理
-    msgHandler(conn, js, time);
+    // 通过消息头部的msgid在业务模块的处理器表中找到对应的处理方法，来执行相应的业务处理
+    // 二进制消息的载荷在处理器中才解析，字段缺失或格式错误时只丢弃这条消息
+    try
+    {
+        ChatService::instance()->dispatch(conn, packet, time);
+    }
+    catch (const json::exception &e)
+    {
+        LOG_ERROR << "msgid: " << packet.getMsgId() << " bad message from " << conn->name() << ": " << e.what();
+    }
 }
@@ -1,11 +1,65 @@
 #include "chatservice.hpp"
 #include "public.hpp"
+#include "codec.hpp"
+#include "session.hpp"
+#include "config.hpp"
+#include "metrics.hpp"
 #include <muduo/base/Logging.h>
 #include <vector>
+#include <array>
+#include <algorithm>
+#include <limits.h>
 
 using namespace muduo;
 using namespace std;
 
+// 群组成员分页查询每页的默认和最大成员数
+static const int kDefaultMemberPageSize = 100;
+static const int kMaxMemberPageSize = 500;
+// 离线消息分页拉取每页的默认和最大条数，以及每页的最大字节数
+static const int kDefaultOfflinePageSize = 100;
+static const int kMaxOfflinePageSize = 500;
+static const size_t kMaxOfflinePageBytes = 1024 * 1024;
+// 群组成员变化的通知通道，消息内容是群组id
+static const string kGroupInvalidateChannel = "chat:group:invalidate";
+// 用户状态最长延迟写入的时间（毫秒），以及触发提前写入的积压用户数，可由配置覆盖
+static const int kUserStateFlushInterval = 200;
+static const int kUserStateMaxPending = 10000;
+// 最多缓存的群组数，可由配置覆盖
+static const int kGroupCacheCapacity = 100000;
+// 全集群路由表，哈希表的字段是用户id，值是用户所在的服务器
+static const string kRouteTable = "chat:route";
+// 用户上下线的通知通道，消息内容是“+用户id@服务器”或“-用户id@服务器”
+static const string kPresenceChannel = "chat:presence";
+// 按服务器路由时，每台服务器订阅的通道前缀，后面跟服务器名
+static const string kNodeChannelPrefix = "chat:node:";
+
+// 处理器表的一项：业务处理方法和它在指标中的名字
+struct HandlerEntry
+{
+    ChatService::MsgHandler handler;
+    const char *name;
+};
+
+// 消息id和其对应的业务处理方法，编译期按msgid建成一张数组，没有处理器的位置为空
+static constexpr array<HandlerEntry, MSG_TYPE_MAX> makeHandlerTable()
+{
+    array<HandlerEntry, MSG_TYPE_MAX> table{};
+    table[LOGIN_MSG] = {&ChatService::loginHandler, "login"};
+    table[LOGINOUT_MSG] = {&ChatService::loginout, "loginout"};
+    table[REGISTER_MSG] = {&ChatService::registerHandler, "register"};
+    table[ONE_CHAT_MSG] = {&ChatService::oneChatHandler, "one_chat"};
+    table[ADD_FRIEND_MSG] = {&ChatService::addFriendHandler, "add_friend"};
+    // 群组业务管理相关事件处理
+    table[CREATE_GROUP_MSG] = {&ChatService::createGroup, "create_group"};
+    table[ADD_GROUP_MSG] = {&ChatService::addGroup, "add_group"};
+    table[GROUP_CHAT_MSG] = {&ChatService::groupChat, "group_chat"};
+    table[GROUP_MEMBERS_MSG] = {&ChatService::groupMembersHandler, "group_members"};
+    table[OFFLINE_MSG] = {&ChatService::offlineMsgHandler, "offline"};
+    return table;
+}
+static constexpr array<HandlerEntry, MSG_TYPE_MAX> kMsgHandlerTable = makeHandlerTable();
+
 // 获取单例对象的接口函数
 ChatService *ChatService::instance()
 {
@@ -14,86 +68,150 @@ ChatService *ChatService::instance()
 }
 
 ChatService::ChatService()
+    : _userStateWriter(Config::instance()->getInt("user_state.flush_interval", kUserStateFlushInterval, 1, INT_MAX),
+                       Config::instance()->getInt("user_state.max_pending", kUserStateMaxPending, 1, INT_MAX)),
+      _groupCache(std::bind(&GroupModel::queryGroupMembers, &_groupModel, _1),
+                  Config::instance()->getInt("cache.group_capacity", kGroupCacheCapacity, 1, INT_MAX)),
+      _workers(nullptr),
+      _routeMode(ROUTE_PER_NODE)
 {
-    // 注册各类消息和对应的消息处理方法
-    _msgHandlerMap.insert({LOGIN_MSG, std::bind(&ChatService::loginHandler, this, _1, _2, _3)});
-
-    _msgHandlerMap.insert({LOGINOUT_MSG, std::bind(&ChatService::loginout, this, _1, _2, _3)});
-    _msgHandlerMap.insert({REGISTER_MSG, std::bind(&ChatService::registerHandler, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ONE_CHAT_MSG, std::bind(&ChatService::oneChatHandler, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ADD_FRIEND_MSG, std::bind(&ChatService::addFriendHandler, this, _1, _2, _3)});
-    // 群组业务管理相关事件处理回调注册
-    _msgHandlerMap.insert({CREATE_GROUP_MSG, std::bind(&ChatService::createGroup, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ADD_GROUP_MSG, std::bind(&ChatService::addGroup, this, _1, _2, _3)});
-    _msgHandlerMap.insert({GROUP_CHAT_MSG, std::bind(&ChatService::groupChat, this, _1, _2, _3)});
+    // 每种消息的处理耗时一个直方图，分发时按msgid直接取编号
+    Metrics *metrics = Metrics::instance();
+    for (int msgId = 0; msgId < MSG_TYPE_MAX; ++msgId)
+    {
+        _handlerMetrics[msgId] = kMsgHandlerTable[msgId].handler != nullptr
+                                     ? metrics->histogram(string("handler.") + kMsgHandlerTable[msgId].name)
+                                     : -1;
+    }
+    _unknownMsgMetric = metrics->counter("handler.unknown");
+}
 
-    // 连接Redis服务器
-    if (_redis.connect())
+// 连接Redis并订阅通知通道
+void ChatService::init(const string &nodeId, RouteMode mode)
+{
+    _nodeId = nodeId;
+    _nodeChannel = kNodeChannelPrefix + nodeId;
+    _routeMode = mode;
+
+    // 连接Redis服务器，地址、密码和发布批处理参数都来自配置
+    Config *config = Config::instance();
+    _redis.setPublishBatch(config->getInt("redis.batch_count", 128, 1, INT_MAX), config->getDouble("redis.batch_window", 0.001));
+    if (_redis.connect(config->getString("redis.host", "127.0.0.1"),
+                       config->getInt("redis.port", 6379, 1, 65535),
+                       config->getString("redis.password", "123456")))
     {
         // 设置上报通道消息的回调方法
         // Redis发现通道上有消息发生时，会给相应的服务器进行上报
         _redis.init_notify_handler(std::bind(&ChatService::redis_subscribe_message_handler, this, _1, _2));
+
+        // 订阅群组成员变化的通知，其他服务器修改群组成员后使本机缓存失效
+        _redis.init_control_handler(std::bind(&ChatService::redis_control_message_handler, this, _1, _2));
+        _redis.subscribe(kGroupInvalidateChannel);
+
+        // 按服务器路由时，整台服务器只订阅这一个通道，用户上下线不再订阅/取消订阅
+        if (_routeMode == ROUTE_PER_NODE)
+        {
+            _redis.subscribe(_nodeChannel);
+        }
+
+        // 先订阅上下线通知再加载路由表，避免漏掉加载期间的变化
+        _redis.subscribe(kPresenceChannel);
+        vector<pair<string, string>> routeVec;
+        _redis.hgetall(kRouteTable, routeVec);
+        for (const auto &route : routeVec)
+        {
+            int userid = atoi(route.first.c_str());
+            // 指向本机的路由是上次没有正常退出时留下的，本机刚启动不可能有在线用户，删除并通知其他服务器
+            if (route.second == _nodeId)
+            {
+                setOnline(userid, false);
+                continue;
+            }
+            _presence.insert(userid, route.second);
+        }
     }
 }
 
+// 更换离线消息的存储
+void ChatService::setOfflineStore(unique_ptr<OfflineStore> store)
+{
+    _offlineMsgModel.setStore(std::move(store));
+}
+
 // 服务端异常终止，业务重置方法
 void ChatService::reset()
 {
-    // 将所有online状态的用户，设置成offline
+    // 本机的在线用户从在线目录中移除
+    for (int id : _userConnMap.userIds())
+    {
+        setOnline(id, false);
+    }
+    // 删除路由的命令是异步投递的，等它们执行完再退出，否则进程退出时命令还没发出
+    if (!_redis.sync())
+    {
+        LOG_ERROR << "remove routes of " << _nodeId << " from redis failed";
+    }
+
+    // 先写完积压的状态，再将所有online状态的用户设置成offline，避免积压的online覆盖重置
+    _userStateWriter.stop();
     _userModel.resetState();
 }
 
-// 获取消息对应的处理器
-MsgHandler ChatService::getHandler(int msgId)
+// 业务模块的运行状态，由查询端口的线程调用
+void ChatService::stats(vector<pair<string, long long>> &stats)
 {
-    // 记录错误日志，msgid没有对应的事件处理回调
-    auto it = _msgHandlerMap.find(msgId);
-    if (it == _msgHandlerMap.end())
+    stats.emplace_back("online.local", _userConnMap.size());
+    stats.emplace_back("online.cluster", _presence.size());
+    stats.emplace_back("redis.connected", _redis.connected() ? 1 : 0);
+    stats.emplace_back("redis.publish.pending", _redis.pendingPublishes());
+    long long backlog = _offlineMsgModel.backlog();
+    if (backlog >= 0)
     {
-        // 返回一个默认的处理器（lambda匿名函数，仅仅用作提示）
-        return [=](const TcpConnectionPtr &, json &, Timestamp)
-        {
-            LOG_ERROR << "msgid: " << msgId << " can not find handler!";
-        };
+        stats.emplace_back("offline.backlog", backlog);
     }
-    return _msgHandlerMap[msgId];
+}
+
+// 按msgid调用对应的处理器，数组下标直接定位，不查哈希表也不拷贝处理器
+void ChatService::dispatch(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
+{
+    int msgId = packet.getMsgId();
+    if (msgId <= 0 || msgId >= MSG_TYPE_MAX || kMsgHandlerTable[msgId].handler == nullptr)
+    {
+        // 记录错误日志，msgid没有对应的事件处理回调
+        LOG_ERROR << "msgid: " << msgId << " can not find handler!";
+        Metrics::instance()->add(_unknownMsgMetric);
+        return;
+    }
+    ScopedLatency latency(_handlerMetrics[msgId]);
+    (this->*kMsgHandlerTable[msgId].handler)(conn, packet, time);
 }
 
 // 登录业务
-void ChatService::loginHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::loginHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
 {
+    json &js = packet.body();
     int id = js["id"].get<int>();
     string password = js["password"];
 
     User user = _userModel.query(id);
     if (user.getId() == id && user.getPassword() == password)
     {
-        if (user.getState() == "online")
+        // 以在线目录判断是否已在集群中某台服务器上登录，user表的state是延迟写入的，可能还没更新
+        if (_presence.contains(id))
         {
             // 该用户已经登录，不允许重复登录
             json response;
             response["msgid"] = LOGIN_MSG_ACK;
             response["errno"] = 2;
             response["errmsg"] = "this account is using, input another!";
-            conn->send(response.dump());
+            ChatCodec::send(conn, Packet::fromJson(response));
         }
         else
         {
-            // 登录成功，记录用户连接信息
-            // 需要考虑线程安全问题
-            // 为了保证并发性，尽量缩小锁的粒度
-            // 这里增加连接操作是临界区代码段，出作用域自动释放锁
-            {
-                lock_guard<mutex> lock(_connMutex);
-                _userConnMap.insert({id, conn});
-            }
-
-            // id用户登录成功后，向Redis订阅channel(id)
-            _redis.subscribe(id);
-
             // 登录成功，更新用户状态信息 state offline => online
+            // 只记在内存中，由后台线程和其他用户的状态变化合并后批量写入数据库
             user.setState("online");
-            _userModel.updateState(user); // 这句话就将数据更新反映到数据库中了，体现了业务模块和数据模块分开的思想
+            _userStateWriter.setState(id, true);
 
             // 合成返回json，都是局部变量，线程之间栈是隔离的，不会产生冲突
             json response;
@@ -102,22 +220,13 @@ void ChatService::loginHandler(const TcpConnectionPtr &conn, json &js, Timestamp
             response["id"] = user.getId();
             response["name"] = user.getName();
 
-            // 查询该用户是否有离线消息
-            vector<string> vec = _offlineMsgModel.query(id);
-            if (!vec.empty())
-            {
-                // json可以直接跟vector容器之间进行序列化和反序列化
-                response["offlinemsg"] = vec;
-                // 读取该用户的离线消息后，把该用户的所有离线消息删除掉
-                _offlineMsgModel.remove(id);
-            }
-            else
-            {
-                LOG_INFO << "无离线消息";
-            }
+            // 离线消息不再放在登录响应中，客户端登录成功后用OFFLINE_MSG分页拉取
+
+            // 好友和群组在同一个连接上一次性加载，查询次数和群组数量无关
+            LoginSnapshot snapshot = _loginModel.load(id);
 
-            // 查询该用户的好友信息并返回（自定义类型）
-            vector<User> userVec = _friendModel.query(id);
+            // 该用户的好友信息并返回（自定义类型）
+            vector<User> &userVec = snapshot.friends;
             if (!userVec.empty())
             {
                 vector<string> vec2;
@@ -126,17 +235,18 @@ void ChatService::loginHandler(const TcpConnectionPtr &conn, json &js, Timestamp
                     json js;
                     js["id"] = user.getId();
                     js["name"] = user.getName();
-                    js["state"] = user.getState();
+                    js["state"] = _presence.contains(user.getId()) ? "online" : "offline";
                     vec2.push_back(js.dump());
                 }
                 response["friends"] = vec2;
             }
 
-            // 查询用户的群组信息
-            vector<Group> groupuserVec = _groupModel.queryGroups(id);
+            // 用户的群组信息
+            vector<Group> &groupuserVec = snapshot.groups;
             if (!groupuserVec.empty())
             {
-                // group:[{groupid:[xxx, xxx, xxx, xxx]}]
+                // group:[{id, groupname, groupdesc, count}]
+                // 只带成员数，成员列表由客户端用GROUP_MEMBERS_MSG分页查询，响应大小和群组规模无关
                 vector<string> groupV;
                 for (Group &group : groupuserVec)
                 {
@@ -144,23 +254,44 @@ void ChatService::loginHandler(const TcpConnectionPtr &conn, json &js, Timestamp
                     grpjson["id"] = group.getId();
                     grpjson["groupname"] = group.getName();
                     grpjson["groupdesc"] = group.getDesc();
-                    vector<string> userV;
-                    for (GroupUser &user : group.getUsers())
-                    {
-                        json js;
-                        js["id"] = user.getId();
-                        js["name"] = user.getName();
-                        js["state"] = user.getState();
-                        js["role"] = user.getRole();
-                        userV.push_back(js.dump());
-                    }
-                    grpjson["users"] = userV;
+                    grpjson["count"] = group.getMemberCount();
                     groupV.push_back(grpjson.dump());
                 }
                 response["groups"] = groupV;
             }
 
-            conn->send(response.dump());
+            // 客户端请求使用二进制协议，响应仍按json编码，之后的消息都切换为二进制帧
+            // 先切换格式再发送响应，客户端收到响应后发来的二进制帧一定按新格式解析
+            bool binary = js.contains("proto") && js["proto"] == "binary";
+            if (binary)
+            {
+                response["proto"] = "binary";
+            }
+            FramePtr ack = ChatCodec::encode(Packet::fromJson(response), WIRE_JSON);
+            if (binary)
+            {
+                getSession(conn)->format = WIRE_BINARY;
+            }
+            ChatCodec::send(conn, ack);
+
+            // 响应发出后再记录用户连接信息，其他业务线程转发来的消息一定排在响应之后
+            // _userConnMap内部保证线程安全，同时把用户id记在连接的会话上，断开连接时不必遍历_userConnMap
+            _userConnMap.insert(id, conn);
+            getSession(conn)->userid = id;
+            setOnline(id, true);
+
+            // 按用户路由时，id用户登录成功后，向Redis订阅channel(id)
+            if (_routeMode == ROUTE_PER_USER)
+            {
+                _redis.subscribe(id);
+            }
+
+            // 连接可能在登录排队期间已经断开，之前的断开处理看到的还是未登录状态，这里补做下线处理
+            // muduo在回调断开之前就把连接标记为断开，所以这里和断开处理至少有一方能看到登录的用户
+            if (!conn->connected())
+            {
+                clientCloseExceptionHandler(conn);
+            }
         }
     }
     else
@@ -170,13 +301,14 @@ void ChatService::loginHandler(const TcpConnectionPtr &conn, json &js, Timestamp
         response["msgid"] = LOGIN_MSG_ACK;
         response["errno"] = 1;
         response["errmsg"] = "incorrect id or password!";
-        conn->send(response.dump());
+        ChatCodec::send(conn, Packet::fromJson(response));
     }
 }
 
 // 注册业务
-void ChatService::registerHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::registerHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
 {
+    json &js = packet.body();
     string name = js["name"];
     string password = js["password"];
 
@@ -192,7 +324,7 @@ void ChatService::registerHandler(const TcpConnectionPtr &conn, json &js, Timest
         response["msgid"] = REGISTER_MSG_ACK;
         response["errno"] = 0;
         response["id"] = user.getId();
-        conn->send(response.dump());
+        ChatCodec::send(conn, Packet::fromJson(response));
     }
     else
     {
@@ -201,99 +333,197 @@ void ChatService::registerHandler(const TcpConnectionPtr &conn, json &js, Timest
         response["msgid"] = REGISTER_MSG_ACK;
         response["errno"] = 1;
         // 注册已经失败，不需要在json返回id
-        conn->send(response.dump());
+        ChatCodec::send(conn, Packet::fromJson(response));
     }
 }
 
 // 处理注销业务
-void ChatService::loginout(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::loginout(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
 {
-    int userid = js["id"].get<int>();
-    {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(userid);
-        if (it != _userConnMap.end())
-        {
-            _userConnMap.erase(it);
-        }
-    }
+    int userid = packet.body()["id"].get<int>();
+    _userConnMap.erase(userid);
+    getSession(conn)->userid = -1;
+    setOnline(userid, false);
 
     // 用户注销（下线），在Redis中取消订阅通道
-    _redis.unsubscribe(userid);
+    if (_routeMode == ROUTE_PER_USER)
+    {
+        _redis.unsubscribe(userid);
+    }
 
-    // 更新用户的状态信息
-    // User user(userid, "", "", "offline");
-    User user(userid);
-    user.setState("offline");
-    _userModel.updateState(user);
+    // 更新用户的状态信息，延迟批量写入
+    _userStateWriter.setState(userid, false);
 }
 
 // 处理客户端异常退出
 void ChatService::clientCloseExceptionHandler(const TcpConnectionPtr &conn)
 {
-    User user;
+    // 从连接的会话上直接取出登录的用户，未登录的连接不需要处理
+    User user(getSession(conn)->userid.exchange(-1));
+    if (user.getId() == -1)
+    {
+        return;
+    }
+
+    // 从map表删除用户的连接信息
+    _userConnMap.erase(user.getId(), conn);
+    setOnline(user.getId(), false);
+
+    // 在Redis中取消订阅通道
+    if (_routeMode == ROUTE_PER_USER)
+    {
+        _redis.unsubscribe(user.getId());
+    }
+
+    // 更新用户的状态信息，延迟批量写入
+    _userStateWriter.setState(user.getId(), false);
+}
+
+// 分页查询群组成员业务
+// 请求：{groupid, cursor: 上一页最后一个成员id（第一页为0）, limit}
+// 响应：{groupid, users: [...], cursor: 本页最后一个成员id, more: 是否还有下一页}
+void ChatService::groupMembersHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
+{
+    json &js = packet.body();
+    int userid = getSession(conn)->userid;
+    int groupid = packet.getTarget();
+    int cursor = js.contains("cursor") ? js["cursor"].get<int>() : 0;
+    int limit = js.contains("limit") ? js["limit"].get<int>() : kDefaultMemberPageSize;
+    limit = std::max(1, std::min(limit, kMaxMemberPageSize));
+
+    json response;
+    response["msgid"] = GROUP_MEMBERS_MSG_ACK;
+    response["groupid"] = groupid;
+
+    // 只有群成员才能查看成员列表，成员缓存是有序的
+    GroupCache::MemberList members = _groupCache.getMembers(groupid);
+    if (!std::binary_search(members->begin(), members->end(), userid))
+    {
+        response["errno"] = 1;
+        response["errmsg"] = "not a member of this group!";
+        ChatCodec::send(conn, Packet::fromJson(response));
+        return;
+    }
+
+    // 多取一个成员判断是否还有下一页
+    vector<GroupUser> userVec = _groupModel.queryMemberPage(groupid, cursor, limit + 1);
+    bool more = userVec.size() > static_cast<size_t>(limit);
+    if (more)
     {
-        lock_guard<mutex> lock(_connMutex);
-        for (auto it = _userConnMap.begin(); it != _userConnMap.end(); ++it)
+        userVec.pop_back();
+    }
+
+    vector<string> userV;
+    userV.reserve(userVec.size());
+    for (GroupUser &user : userVec)
+    {
+        json userjs;
+        userjs["id"] = user.getId();
+        userjs["name"] = user.getName();
+        userjs["state"] = _presence.contains(user.getId()) ? "online" : "offline";
+        userjs["role"] = user.getRole();
+        userV.push_back(userjs.dump());
+    }
+    response["errno"] = 0;
+    response["users"] = userV;
+    response["cursor"] = userVec.empty() ? cursor : userVec.back().getId();
+    response["more"] = more;
+    ChatCodec::send(conn, Packet::fromJson(response));
+}
+
+// 拉取离线消息业务
+// 请求：{ack: 客户端已经处理完的最大消息id（第一次为0）, limit}
+// 响应：{msgs: [...], cursor: 本页最后一条消息的id}，空页表示已经取完
+// 每次请求先删除已确认的部分再返回下一页，没有确认的消息不会丢失
+void ChatService::offlineMsgHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
+{
+    json &js = packet.body();
+    // 只能拉取自己的离线消息，用户id以连接会话为准
+    const SessionPtr &session = getSession(conn);
+    int userid = session->userid;
+    if (userid == -1)
+    {
+        return;
+    }
+    long long ack = js.contains("ack") ? js["ack"].get<long long>() : 0;
+    int limit = js.contains("limit") ? js["limit"].get<int>() : kDefaultOfflinePageSize;
+    limit = std::max(1, std::min(limit, kMaxOfflinePageSize));
+
+    // 只删除上一页中确实发给了这个连接、且不超过ack的消息
+    // id比上一页小但晚提交的消息没有发出过，不会被删掉，下次登录从头拉取时还能取到
+    vector<long long> acked;
+    for (long long id : session->offlineIds)
+    {
+        if (id <= ack)
         {
-            if (it->second == conn)
-            {
-                // 从map表删除用户的连接信息
-                user.setId(it->first);
-                _userConnMap.erase(it);
-                break;
-            }
+            acked.push_back(id);
         }
     }
+    if (!acked.empty())
+    {
+        _offlineMsgModel.remove(userid, acked);
+    }
 
-    // 在Redis中取消订阅通道
-    _redis.unsubscribe(user.getId());
+    vector<OfflineMessage> msgVec = _offlineMsgModel.query(userid, ack, limit, kMaxOfflinePageBytes);
+    vector<string> msgs;
+    msgs.reserve(msgVec.size());
+    session->offlineIds.clear();
+    for (OfflineMessage &msg : msgVec)
+    {
+        session->offlineIds.push_back(msg.id);
+        msgs.push_back(std::move(msg.message));
+    }
+
+    json response;
+    response["msgid"] = OFFLINE_MSG_ACK;
+    response["msgs"] = msgs;
+    response["cursor"] = msgVec.empty() ? ack : msgVec.back().id;
+    ChatCodec::send(conn, Packet::fromJson(response));
+}
 
-    // 更新用户的状态信息
-    // 如果用户不合法（未登录/找到），不必再向数据库进行请求
-    if (user.getId() != -1)
+// 按格式取出消息编码好的帧，第一次用到时才编码
+static const FramePtr &frameOf(const Packet &packet, FramePtr (&frames)[2], int format)
+{
+    if (!frames[format])
     {
-        user.setState("offline");
-        _userModel.updateState(user);
+        frames[format] = ChatCodec::encode(packet, format);
     }
+    return frames[format];
 }
 
 // 一对一聊天业务
-void ChatService::oneChatHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::oneChatHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
 {
-    // 需要接收信息的用户ID
-    int toId = js["toid"].get<int>();
+    // 需要接收信息的用户ID，从消息头部获取，不需要解析载荷
+    int toId = packet.getTarget();
 
+    // 确认toId是在本机在线，转发消息（服务器主动推送消息给toId用户）
+    TcpConnectionPtr toConn = _userConnMap.find(toId);
+    if (toConn)
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(toId);
-        // 确认toId是在线状态，转发消息（服务器主动推送消息给toId用户）
-        if (it != _userConnMap.end())
-        {
-            // 直接发送消息
-            it->second->send(js.dump());
-            // return和‘}’，lock离开作用域，调用析构函数，释放锁
-            return;
-        }
+        // 直接转发原始载荷，按接收方协商的格式编码
+        ChatCodec::send(toConn, packet);
+        return;
     }
 
-    // 查询toId是否在线
-    User user = _userModel.query(toId);
-    if (user.getState() == "online")
+    // 查询toId在哪台服务器上在线，只查本机的在线目录
+    string node = _presence.nodeOf(toId);
+    if (!node.empty() && node != _nodeId)
     {
         // 用户不在本机，但状态在线，说明在其他主机上
-        // 向对端用户id命名的通道发布消息
-        _redis.publish(toId, js.dump());
+        // 消息以二进制帧的形式跨服务器传递，保留头部信息
+        forward(toId, node, ChatCodec::encode(packet, WIRE_BINARY), make_shared<const string>(packet.getPayload()));
         return;
     }
 
     // toId不在线，存储离线消息
-    _offlineMsgModel.insert(toId, js.dump());
+    _offlineMsgModel.insert(toId, packet.getPayload());
 }
 
 // 添加好友业务
-void ChatService::addFriendHandler(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::addFriendHandler(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
 {
+    json &js = packet.body();
     int userId = js["id"].get<int>();
     int friendId = js["friendid"].get<int>();
 
@@ -303,8 +533,9 @@ void ChatService::addFriendHandler(const TcpConnectionPtr &conn, json &js, Times
 }
 
 // 创建群组业务
-void ChatService::createGroup(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::createGroup(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
 {
+    json &js = packet.body();
     int userId = js["id"].get<int>();
     string name = js["groupname"];
     string desc = js["groupdesc"];
@@ -316,64 +547,272 @@ void ChatService::createGroup(const TcpConnectionPtr &conn, json &js, Timestamp
         // 存储群组创建人信息
         // role：更好的做法是在model层定义一些常量，然后在业务层使用
         _groupModel.addGroup(userId, group.getId(), "creator");
+        invalidateGroup(group.getId());
     }
 }
 
 // 加入群组业务
-void ChatService::addGroup(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::addGroup(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
 {
+    json &js = packet.body();
     int userId = js["id"].get<int>();
     int groupId = js["groupid"].get<int>();
     _groupModel.addGroup(userId, groupId, "normal");
+    invalidateGroup(groupId);
 }
 
 // 群组聊天业务
-void ChatService::groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::groupChat(const TcpConnectionPtr &conn, Packet &packet, Timestamp time)
 {
-    int userId = js["id"].get<int>();
-    int groupId = js["groupid"].get<int>();
-    vector<int> userIdVec = _groupModel.queryGroupUsers(userId, groupId);
-
-    lock_guard<mutex> lock(_connMutex);
-    for (int id : userIdVec)
+    // 群友在本机在线，转发群消息
+    FramePtr frames[2];
+    vector<int> otherIdVec = fanOutLocal(packet, frames);
+
+    vector<int> offlineIdVec;
+    // 按服务器路由时，同一台服务器上的群友只发布一次，由对端服务器根据自己的群组成员在本机扇出
+    unordered_map<string, vector<int>> nodeMembers;
+    shared_ptr<const string> payload;
+    for (int id : otherIdVec)
     {
-        auto it = _userConnMap.find(id);
-        if (it != _userConnMap.end())
+        // 查询群友在哪台服务器上在线，只查本机的在线目录
+        string node = _presence.nodeOf(id);
+        if (node.empty() || node == _nodeId)
         {
-            // 群友在线，转发群消息
-            it->second->send(js.dump());
+            offlineIdVec.push_back(id);
+        }
+        else if (_routeMode == ROUTE_PER_NODE)
+        {
+            nodeMembers[node].push_back(id);
         }
         else
         {
-            // 查询toId是否在线
-            User user = _userModel.query(id);
-            if (user.getState() == "online")
-            {
-                _redis.publish(id, js.dump());
-            }
-            else
+            // 跨服务器传递的就是二进制帧，和本机二进制连接共用，所有发布进入同一批次写出
+            if (!payload)
             {
-                // 群友不在线，转储离线消息
-                _offlineMsgModel.insert(id, js.dump());
+                payload = make_shared<const string>(packet.getPayload());
             }
+            forward(id, node, frameOf(packet, frames, WIRE_BINARY), payload);
+        }
+    }
+
+    if (!nodeMembers.empty())
+    {
+        // 每台服务器发布同一个信封，对端服务器挂掉时把它上面的群友转储离线消息
+        if (!payload)
+        {
+            payload = make_shared<const string>(packet.getPayload());
+        }
+        FramePtr envelope = ChatCodec::wrap(ChatCodec::kGroupRecipient, *frameOf(packet, frames, WIRE_BINARY));
+        for (auto &entry : nodeMembers)
+        {
+            _redis.publish(kNodeChannelPrefix + entry.first, envelope, offlineOnMiss(std::move(entry.second), payload));
+        }
+    }
+
+    // 不在线的群友一起转储离线消息
+    _offlineMsgModel.insert(offlineIdVec, packet.getPayload());
+}
+
+// 把群消息发给本机连接上的群友
+vector<int> ChatService::fanOutLocal(const Packet &packet, FramePtr (&frames)[2])
+{
+    int userId = packet.getSender();
+    int groupId = packet.getTarget();
+    // 从群组成员缓存中取出除自己以外的成员
+    GroupCache::MemberList members = _groupCache.getMembers(groupId);
+    vector<int> userIdVec;
+    userIdVec.reserve(members->size());
+    for (int id : *members)
+    {
+        if (id != userId)
+        {
+            userIdVec.push_back(id);
+        }
+    }
+
+    // 只在取本机在线群友连接的快照时加锁，发送都在锁外进行
+    vector<int> otherIdVec;
+    vector<TcpConnectionPtr> connVec = _userConnMap.find(userIdVec, otherIdVec);
+
+    // 每种编码格式只编码一次，所有群友共享同一份帧
+    for (const TcpConnectionPtr &memberConn : connVec)
+    {
+        ChatCodec::send(memberConn, frameOf(packet, frames, getSession(memberConn)->format));
+    }
+    return otherIdVec;
+}
+
+// 其他服务器转来的群消息，在本机扇出，在业务线程中执行
+void ChatService::deliverGroup(const Packet &packet)
+{
+    FramePtr frames[2];
+    vector<int> otherIdVec = fanOutLocal(packet, frames);
+
+    // 路由表指向本机但已经断开的群友，由本机转储离线消息
+    // 其他服务器上的群友和离线的群友由发送方所在的服务器处理
+    vector<int> offlineIdVec;
+    for (int id : otherIdVec)
+    {
+        if (_presence.nodeOf(id) == _nodeId)
+        {
+            offlineIdVec.push_back(id);
         }
     }
+    _offlineMsgModel.insert(offlineIdVec, packet.getPayload());
 }
 
 // 从redis消息队列中获取订阅的消息，这里channel其实就是id
 void ChatService::redis_subscribe_message_handler(int channel, string message)
+{
+    // 通道上传递的是二进制帧，还原出头部和载荷
+    Packet packet;
+    if (!ChatCodec::decode(message.data(), message.size(), packet))
+    {
+        LOG_ERROR << "bad message on channel " << channel;
+        return;
+    }
+    deliver(channel, packet);
+}
+
+// 其他服务器发到本机通道的消息，信封里带着接收方
+void ChatService::nodeMessageHandler(const string &message)
+{
+    int userid = -1;
+    Packet packet;
+    if (!ChatCodec::unwrap(message, userid, packet))
+    {
+        LOG_ERROR << "bad message on channel " << _nodeChannel;
+        return;
+    }
+
+    if (userid == ChatCodec::kGroupRecipient)
+    {
+        // 成员缓存未命中时要查数据库，还要转储离线消息，和groupChat一样交给发送方的业务线程
+        runInWorker(packet.getSender(), [this, packet = std::move(packet)]()
+                    { deliverGroup(packet); });
+    }
+    else
+    {
+        deliver(userid, packet);
+    }
+}
+
+// 把跨服务器送来的消息交给本机的用户
+void ChatService::deliver(int userid, const Packet &packet)
 {
     // 用户在线
-    lock_guard<mutex> lock(_connMutex);
-    auto it = _userConnMap.find(channel);
-    if (it != _userConnMap.end())
+    TcpConnectionPtr conn = _userConnMap.find(userid);
+    if (conn)
     {
         // 直接转发消息
-        it->second->send(message);
+        ChatCodec::send(conn, packet);
         return;
     }
 
     // 向通道发布消息、从通道取消息的过程中，接收方用户下线
-    // 用户不在线，转储离线消息
-    _offlineMsgModel.insert(channel, message);
+    // 用户不在线，转储离线消息；这里在Redis的事件循环中，写数据库交给接收方的业务线程
+    runInWorker(userid, [this, userid, payload = packet.getPayload()]()
+                { _offlineMsgModel.insert(userid, payload); });
+}
+
+// 把会访问数据库的任务按key交给业务线程
+// Redis的回调都在同一个事件循环线程中执行，在这里等待MySQL会卡住整个进程的发布和订阅
+void ChatService::runInWorker(size_t key, WorkerPool::Task task)
+{
+    if (_workers != nullptr)
+    {
+        _workers->submit(key, std::move(task));
+    }
+    else
+    {
+        task();
+    }
+}
+
+// 从redis控制通道中获取其他服务器的通知
+void ChatService::redis_control_message_handler(string channel, string message)
+{
+    if (channel == _nodeChannel)
+    {
+        nodeMessageHandler(message);
+    }
+    else if (channel == kGroupInvalidateChannel)
+    {
+        _groupCache.invalidate(atoi(message.c_str()));
+    }
+    else if (channel == kPresenceChannel && !message.empty())
+    {
+        size_t at = message.find('@');
+        if (at == string::npos)
+        {
+            return;
+        }
+        int userid = atoi(message.c_str() + 1);
+        string node = message.substr(at + 1);
+        if (message[0] == '+')
+        {
+            _presence.insert(userid, node);
+        }
+        else
+        {
+            _presence.erase(userid, node);
+        }
+    }
+}
+
+// 更新用户的在线状态：本机目录、Redis路由表，并通知其他服务器
+void ChatService::setOnline(int userid, bool online)
+{
+    string id = to_string(userid);
+    if (online)
+    {
+        _presence.insert(userid, _nodeId);
+        _redis.hset(kRouteTable, id, _nodeId);
+        _redis.publish(kPresenceChannel, "+" + id + "@" + _nodeId);
+    }
+    else
+    {
+        // 用户可能已经登录到其他服务器，只删除仍指向本机的路由
+        _presence.erase(userid, _nodeId);
+        _redis.hdelIfEqual(kRouteTable, id, _nodeId);
+        _redis.publish(kPresenceChannel, "-" + id + "@" + _nodeId);
+    }
+}
+
+// 群组成员变化：本机缓存失效，并通知其他服务器
+// 本机也会收到自己发布的通知，重复失效没有副作用
+void ChatService::invalidateGroup(int groupid)
+{
+    _groupCache.invalidate(groupid);
+    _redis.publish(kGroupInvalidateChannel, to_string(groupid));
+}
+
+// 把二进制帧转发给userid所在的服务器
+void ChatService::forward(int userid, const string &node, const FramePtr &frame, const shared_ptr<const string> &payload)
+{
+    if (_routeMode == ROUTE_PER_NODE)
+    {
+        // 发往接收方所在服务器的通道，信封里带上接收方
+        _redis.publish(kNodeChannelPrefix + node, ChatCodec::wrap(userid, *frame), offlineOnMiss({userid}, payload));
+    }
+    else
+    {
+        // 向对端用户id命名的通道发布消息
+        _redis.publish(userid, frame, offlineOnMiss({userid}, payload));
+    }
+}
+
+// 发布结果的回调：没有订阅者收到说明接收方（或它所在的服务器）在发布前已经下线，转储离线消息
+// 回调在Redis的事件循环中执行，写数据库交给第一个接收方的业务线程
+Redis::PublishCallback ChatService::offlineOnMiss(vector<int> userids, shared_ptr<const string> payload)
+{
+    return [this, userids = std::move(userids), payload](bool ok, long long receivers) mutable
+    {
+        if (receivers == 0 && !userids.empty())
+        {
+            size_t key = userids.front();
+            runInWorker(key, [this, userids = std::move(userids), payload]()
+                        { _offlineMsgModel.insert(userids, *payload); });
+        }
+    };
 }
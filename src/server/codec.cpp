@@ -0,0 +1,204 @@
+#include "codec.hpp"
+#include "session.hpp"
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <arpa/inet.h>
+#include <string.h>
+
+ChatCodec::ChatCodec(const PacketCallback &cb, int32_t maxMessageLen)
+    : _messageCallback(cb), _maxMessageLen(maxMessageLen)
+{
+}
+
+// 一次回调中可能有多条完整消息（粘包），也可能不足一条（半包）
+void ChatCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time)
+{
+    const SessionPtr &session = getSession(conn);
+    for (;;)
+    {
+        // 每一帧都重新读取格式，登录协商成功后紧跟的帧就按新格式解析
+        Packet packet;
+        DecodeResult result = session->format == WIRE_BINARY
+                                  ? decodeBinary(conn, buf, packet)
+                                  : decodeJson(conn, buf, packet);
+        if (result == kIncomplete)
+        {
+            break;
+        }
+        if (result == kError)
+        {
+            // 长度非法之后的字节无法再分帧，丢弃缓冲区并直接关闭连接
+            // shutdown只关闭写端，留在Buffer中的坏数据会在之后每次读到数据时被重复解析
+            buf->retrieveAll();
+            conn->forceClose();
+            break;
+        }
+        if (result == kPacket)
+        {
+            _messageCallback(conn, packet, time);
+        }
+    }
+}
+
+ChatCodec::DecodeResult ChatCodec::decodeJson(const TcpConnectionPtr &conn, Buffer *buf, Packet &packet)
+{
+    if (buf->readableBytes() < kHeaderLen)
+    {
+        return kIncomplete;
+    }
+
+    // 只窥视长度头，不移动读指针
+    const int32_t len = buf->peekInt32();
+    if (len < 0 || len > _maxMessageLen)
+    {
+        LOG_ERROR << "invalid message length " << len << " from " << conn->name();
+        return kError;
+    }
+
+    // 消息体还没收全，留在Buffer中等待下一次回调
+    if (buf->readableBytes() < static_cast<size_t>(kHeaderLen + len))
+    {
+        return kIncomplete;
+    }
+
+    buf->retrieve(kHeaderLen);
+    const char *begin = buf->peek();
+    DecodeResult result = kPacket;
+    try
+    {
+        // 直接在Buffer的内存上解析，原始文本留作载荷，转发时不必重新dump
+        packet = Packet::fromJson(json::parse(begin, begin + len), string(begin, len));
+    }
+    catch (const json::exception &e)
+    {
+        LOG_ERROR << "json parse error from " << conn->name() << ": " << e.what();
+        result = kSkipped;
+    }
+    buf->retrieve(len);
+    return result;
+}
+
+ChatCodec::DecodeResult ChatCodec::decodeBinary(const TcpConnectionPtr &conn, Buffer *buf, Packet &packet)
+{
+    if (buf->readableBytes() < Packet::kBinaryHeaderLen)
+    {
+        return kIncomplete;
+    }
+
+    uint32_t len = 0;
+    memcpy(&len, buf->peek() + 12, sizeof(len));
+    len = ntohl(len);
+    if (len > static_cast<uint32_t>(_maxMessageLen))
+    {
+        LOG_ERROR << "invalid message length " << len << " from " << conn->name();
+        return kError;
+    }
+    if (buf->readableBytes() < Packet::kBinaryHeaderLen + len)
+    {
+        return kIncomplete;
+    }
+
+    decode(buf->peek(), Packet::kBinaryHeaderLen + len, packet);
+    buf->retrieve(Packet::kBinaryHeaderLen + len);
+    return kPacket;
+}
+
+// 从一段完整的二进制帧中解出消息
+bool ChatCodec::decode(const char *data, size_t len, Packet &packet)
+{
+    if (len < Packet::kBinaryHeaderLen)
+    {
+        return false;
+    }
+
+    uint16_t msgid = 0;
+    int32_t sender = 0;
+    int32_t target = 0;
+    uint32_t payloadLen = 0;
+    memcpy(&msgid, data, sizeof(msgid));
+    memcpy(&sender, data + 4, sizeof(sender));
+    memcpy(&target, data + 8, sizeof(target));
+    memcpy(&payloadLen, data + 12, sizeof(payloadLen));
+    payloadLen = ntohl(payloadLen);
+    if (len != Packet::kBinaryHeaderLen + payloadLen)
+    {
+        return false;
+    }
+
+    packet = Packet(ntohs(msgid), static_cast<int32_t>(ntohl(sender)), static_cast<int32_t>(ntohl(target)),
+                    string(data + Packet::kBinaryHeaderLen, payloadLen));
+    return true;
+}
+
+// 把二进制帧装进发往接收方所在服务器的信封
+FramePtr ChatCodec::wrap(int recipient, const string &frame)
+{
+    Buffer buf;
+    buf.appendInt32(recipient);
+    buf.append(frame.data(), frame.size());
+    return std::make_shared<const string>(buf.retrieveAllAsString());
+}
+
+// 拆开信封，取出接收方和消息
+bool ChatCodec::unwrap(const string &message, int &recipient, Packet &packet)
+{
+    if (message.size() < sizeof(int32_t))
+    {
+        return false;
+    }
+    int32_t be = 0;
+    memcpy(&be, message.data(), sizeof(be));
+    recipient = static_cast<int32_t>(ntohl(be));
+    return decode(message.data() + sizeof(be), message.size() - sizeof(be), packet);
+}
+
+// 按指定格式把消息编码成一帧，追加到buf中
+void ChatCodec::encode(const Packet &packet, int format, Buffer *buf)
+{
+    const string &payload = packet.getPayload();
+    if (format == WIRE_BINARY)
+    {
+        buf->appendInt16(static_cast<int16_t>(packet.getMsgId()));
+        buf->appendInt16(0);
+        buf->appendInt32(packet.getSender());
+        buf->appendInt32(packet.getTarget());
+        buf->appendInt32(static_cast<int32_t>(payload.size()));
+    }
+    else
+    {
+        buf->appendInt32(static_cast<int32_t>(payload.size()));
+    }
+    buf->append(payload.data(), payload.size());
+}
+
+// 按指定格式把消息编码成一帧共享的缓冲区
+FramePtr ChatCodec::encode(const Packet &packet, int format)
+{
+    Buffer buf;
+    encode(packet, format, &buf);
+    return std::make_shared<const string>(buf.retrieveAllAsString());
+}
+
+// 发送已编码好的帧
+void ChatCodec::send(const TcpConnectionPtr &conn, const FramePtr &frame)
+{
+    EventLoop *loop = conn->getLoop();
+    if (loop->isInLoopThread())
+    {
+        conn->send(*frame);
+    }
+    else
+    {
+        // TcpConnection::send跨线程时会把消息拷贝一份，这里只把共享的帧交给连接所在的IO线程
+        loop->runInLoop([conn, frame]()
+                        { conn->send(*frame); });
+    }
+}
+
+// 按接收方连接协商的格式编码后发送
+void ChatCodec::send(const TcpConnectionPtr &conn, const Packet &packet)
+{
+    Buffer buf;
+    encode(packet, getSession(conn)->format, &buf);
+    conn->send(&buf);
+}
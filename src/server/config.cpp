@@ -0,0 +1,156 @@
+#include "config.hpp"
+#include <muduo/base/Logging.h>
+#include <fstream>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+
+using namespace std;
+
+// 去掉首尾的空白字符
+static string trim(const string &s)
+{
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == string::npos)
+    {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+// 获取配置单例对象
+Config *Config::instance()
+{
+    static Config config;
+    return &config;
+}
+
+// 加载配置文件
+bool Config::load(const string &file)
+{
+    ifstream in(file);
+    if (!in)
+    {
+        return false;
+    }
+
+    string line;
+    int lineNo = 0;
+    while (getline(in, line))
+    {
+        ++lineNo;
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == string::npos)
+        {
+            LOG_ERROR << file << ":" << lineNo << " ignored, expect key = value";
+            continue;
+        }
+        // 已经设置的配置（命令行参数）优先
+        _values.emplace(trim(line.substr(0, eq)), trim(line.substr(eq + 1)));
+    }
+    return true;
+}
+
+// 解析命令行参数
+void Config::parseArgs(int argc, char **argv, vector<string> &positional)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            positional.push_back(arg);
+            continue;
+        }
+        // 只写“--key”相当于“--key=true”，用于开关
+        size_t eq = arg.find('=');
+        if (eq == string::npos)
+        {
+            _values[arg.substr(2)] = "true";
+        }
+        else
+        {
+            _values[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+        }
+    }
+}
+
+string Config::getString(const string &key, const string &def) const
+{
+    auto it = _values.find(key);
+    return it == _values.end() ? def : it->second;
+}
+
+int Config::getInt(const string &key, int def) const
+{
+    auto it = _values.find(key);
+    if (it == _values.end())
+    {
+        return def;
+    }
+    char *end = nullptr;
+    errno = 0;
+    long value = strtol(it->second.c_str(), &end, 10);
+    if (errno != 0 || end == it->second.c_str() || *end != '\0' || value < INT_MIN || value > INT_MAX)
+    {
+        LOG_ERROR << "config " << key << " = " << it->second << " is not an integer, use " << def;
+        return def;
+    }
+    return static_cast<int>(value);
+}
+
+int Config::getInt(const string &key, int def, int min, int max) const
+{
+    int value = getInt(key, def);
+    if (value < min || value > max)
+    {
+        int clamped = value < min ? min : max;
+        LOG_ERROR << "config " << key << " = " << value << " is out of range [" << min << ", " << max
+                  << "], use " << clamped;
+        return clamped;
+    }
+    return value;
+}
+
+double Config::getDouble(const string &key, double def) const
+{
+    auto it = _values.find(key);
+    if (it == _values.end())
+    {
+        return def;
+    }
+    char *end = nullptr;
+    double value = strtod(it->second.c_str(), &end);
+    if (end == it->second.c_str() || *end != '\0')
+    {
+        LOG_ERROR << "config " << key << " = " << it->second << " is not a number, use " << def;
+        return def;
+    }
+    return value;
+}
+
+bool Config::getBool(const string &key, bool def) const
+{
+    auto it = _values.find(key);
+    if (it == _values.end())
+    {
+        return def;
+    }
+    const string &value = it->second;
+    if (value == "true" || value == "yes" || value == "on" || value == "1")
+    {
+        return true;
+    }
+    if (value == "false" || value == "no" || value == "off" || value == "0")
+    {
+        return false;
+    }
+    LOG_ERROR << "config " << key << " = " << value << " is not a bool, use " << def;
+    return def;
+}
@@ -0,0 +1,106 @@
+#include "connectionregistry.hpp"
+#include <mutex>
+
+ConnectionRegistry::ConnectionRegistry()
+    : _size(0)
+{
+}
+
+// 记录用户的连接，已存在时覆盖
+void ConnectionRegistry::insert(int userid, const TcpConnectionPtr &conn)
+{
+    Shard &shard = shardOf(userid);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.conns.insert_or_assign(userid, conn).second)
+    {
+        ++_size;
+    }
+}
+
+// 删除用户的连接，返回是否存在
+bool ConnectionRegistry::erase(int userid)
+{
+    Shard &shard = shardOf(userid);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.conns.erase(userid) > 0)
+    {
+        --_size;
+        return true;
+    }
+    return false;
+}
+
+// 仅当用户当前的连接是conn时才删除
+bool ConnectionRegistry::erase(int userid, const TcpConnectionPtr &conn)
+{
+    Shard &shard = shardOf(userid);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.conns.find(userid);
+    if (it != shard.conns.end() && it->second == conn)
+    {
+        shard.conns.erase(it);
+        --_size;
+        return true;
+    }
+    return false;
+}
+
+// 批量查找，先按分片归类，每个分片只加一次读锁
+std::vector<TcpConnectionPtr> ConnectionRegistry::find(const std::vector<int> &userids, std::vector<int> &others) const
+{
+    std::vector<int> buckets[kShardCount];
+    for (int userid : userids)
+    {
+        buckets[static_cast<unsigned>(userid) & (kShardCount - 1)].push_back(userid);
+    }
+
+    std::vector<TcpConnectionPtr> conns;
+    conns.reserve(userids.size());
+    for (int i = 0; i < kShardCount; ++i)
+    {
+        if (buckets[i].empty())
+        {
+            continue;
+        }
+        const Shard &shard = _shards[i];
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (int userid : buckets[i])
+        {
+            auto it = shard.conns.find(userid);
+            if (it != shard.conns.end())
+            {
+                conns.push_back(it->second);
+            }
+            else
+            {
+                others.push_back(userid);
+            }
+        }
+    }
+    return conns;
+}
+
+// 本机全部在线用户的id
+std::vector<int> ConnectionRegistry::userIds() const
+{
+    std::vector<int> ids;
+    ids.reserve(_size);
+    for (const Shard &shard : _shards)
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (const auto &entry : shard.conns)
+        {
+            ids.push_back(entry.first);
+        }
+    }
+    return ids;
+}
+
+// 查找用户的连接，只加分片的读锁
+TcpConnectionPtr ConnectionRegistry::find(int userid) const
+{
+    const Shard &shard = shardOf(userid);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.conns.find(userid);
+    return it != shard.conns.end() ? it->second : TcpConnectionPtr();
+}
@@ -0,0 +1,169 @@
+#include "connectionpool.hpp"
+#include "config.hpp"
+#include <muduo/base/Logging.h>
+#include <limits.h>
+
+// 获取连接池单例对象
+ConnectionPool *ConnectionPool::instance()
+{
+    static ConnectionPool pool;
+    return &pool;
+}
+
+ConnectionPool::ConnectionPool()
+    : _minSize(Config::instance()->getInt("mysql.pool_min", 4, 0, INT_MAX)),
+      _maxSize(Config::instance()->getInt("mysql.pool_max", 32, 1, INT_MAX)),
+      _maxIdleTime(Config::instance()->getInt("mysql.pool_max_idle", 60, 1, INT_MAX)),
+      _pingIdleTime(Config::instance()->getInt("mysql.pool_ping_idle", 5, 0, INT_MAX)),
+      _connectionTimeout(Config::instance()->getInt("mysql.pool_timeout", 1000, 1, INT_MAX)),
+      _connectionCnt(0),
+      _stop(false)
+{
+    // 最少连接数不能超过最大连接数
+    if (_minSize > _maxSize)
+    {
+        LOG_ERROR << "config mysql.pool_min = " << _minSize << " is greater than mysql.pool_max = " << _maxSize
+                  << ", use " << _maxSize;
+        _minSize = _maxSize;
+    }
+
+    // 预先创建最少数量的连接
+    for (int i = 0; i < _minSize; ++i)
+    {
+        MySQL *conn = createConnection();
+        if (conn == nullptr)
+        {
+            break;
+        }
+        conn->refreshAliveTime();
+        _connectionQue.push_back(conn);
+        ++_connectionCnt;
+    }
+
+    _scanner = thread(std::bind(&ConnectionPool::scannerConnectionTask, this));
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        _stop = true;
+    }
+    _scannerCv.notify_all();
+    _scanner.join();
+
+    while (!_connectionQue.empty())
+    {
+        delete _connectionQue.front();
+        _connectionQue.pop_front();
+    }
+}
+
+// 创建一个新连接，成功返回连接对象，失败返回nullptr
+MySQL *ConnectionPool::createConnection()
+{
+    MySQL *conn = new MySQL();
+    if (!conn->connect())
+    {
+        delete conn;
+        return nullptr;
+    }
+    return conn;
+}
+
+// 从连接池中借出一个可用连接
+shared_ptr<MySQL> ConnectionPool::getConnection()
+{
+    MySQL *conn = nullptr;
+    {
+        unique_lock<mutex> lock(_queueMutex);
+        while (_connectionQue.empty() && _connectionCnt >= _maxSize)
+        {
+            // 连接已经用完，等待其他线程归还
+            if (cv_status::timeout == _cv.wait_for(lock, chrono::milliseconds(_connectionTimeout)) &&
+                _connectionQue.empty() && _connectionCnt >= _maxSize)
+            {
+                LOG_ERROR << "get mysql connection timeout!";
+                return nullptr;
+            }
+        }
+
+        if (!_connectionQue.empty())
+        {
+            // 优先借出最近归还的连接，让多余的连接在队头空闲，便于扫描线程回收
+            conn = _connectionQue.back();
+            _connectionQue.pop_back();
+        }
+        else
+        {
+            // 还没达到上限，先占住名额，在锁外创建新连接
+            ++_connectionCnt;
+        }
+    }
+
+    if (conn == nullptr)
+    {
+        conn = createConnection();
+        if (conn == nullptr)
+        {
+            --_connectionCnt;
+            _cv.notify_one();
+            return nullptr;
+        }
+    }
+    else if (conn->getIdleSeconds() > _pingIdleTime && !conn->ping())
+    {
+        // 空闲太久的连接可能已被MySQL服务端断开，检查失败就换一个新连接
+        LOG_INFO << "mysql connection is broken, reconnect";
+        delete conn;
+        conn = createConnection();
+        if (conn == nullptr)
+        {
+            --_connectionCnt;
+            _cv.notify_one();
+            return nullptr;
+        }
+    }
+
+    // 智能指针析构时把连接归还到连接池，而不是关闭连接
+    return shared_ptr<MySQL>(conn, [this](MySQL *p)
+                             { releaseConnection(p); });
+}
+
+// 把借出的连接归还到空闲队列
+void ConnectionPool::releaseConnection(MySQL *conn)
+{
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        conn->refreshAliveTime();
+        _connectionQue.push_back(conn);
+    }
+    _cv.notify_one();
+}
+
+// 当前空闲连接数
+int ConnectionPool::idleSize()
+{
+    lock_guard<mutex> lock(_queueMutex);
+    return _connectionQue.size();
+}
+
+// 扫描线程：回收空闲时间超过_maxIdleTime的多余连接
+void ConnectionPool::scannerConnectionTask()
+{
+    unique_lock<mutex> lock(_queueMutex);
+    while (!_stop)
+    {
+        _scannerCv.wait_for(lock, chrono::seconds(_maxIdleTime));
+
+        // 队头的连接空闲时间最长，只回收超过最少连接数的部分
+        while (!_stop && _connectionCnt > _minSize && !_connectionQue.empty() &&
+               _connectionQue.front()->getIdleSeconds() >= _maxIdleTime)
+        {
+            MySQL *conn = _connectionQue.front();
+            _connectionQue.pop_front();
+            --_connectionCnt;
+            delete conn;
+        }
+    }
+}
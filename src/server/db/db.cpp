@@ -1,12 +1,7 @@
 #include "db.h"
+#include "config.hpp"
 #include <muduo/base/Logging.h>
 
-// 数据库配置信息
-static string server = "127.0.0.1";
-static string user = "root";
-static string password = "123456";
-static string dbname = "chat";
-
 MySQL::MySQL()
 {
     _conn = mysql_init(nullptr);
@@ -14,18 +9,29 @@ MySQL::MySQL()
 // 释放数据库连接资源
 MySQL::~MySQL()
 {
+    // 语句句柄依赖连接，先关闭语句再关闭连接
+    _stmtCache.clear();
     if (_conn != nullptr)
         mysql_close(_conn);
 }
 // 连接数据库
 bool MySQL::connect()
 {
+    // 数据库配置信息
+    Config *config = Config::instance();
+    string server = config->getString("mysql.host", "127.0.0.1");
+    string user = config->getString("mysql.user", "root");
+    string password = config->getString("mysql.password", "123456");
+    string dbname = config->getString("mysql.dbname", "chat");
+    int port = config->getInt("mysql.port", 3306, 1, 65535);
+
     MYSQL *p = mysql_real_connect(_conn, server.c_str(), user.c_str(),
-                                  password.c_str(), dbname.c_str(), 3306, nullptr, 0);
+                                  password.c_str(), dbname.c_str(), port, nullptr, 0);
     if (p != nullptr)
     {
         // C和C++代码默认的编码字符是ASCII，如果不设置，从MySQL上拉下来的中文显示？
-        mysql_query(_conn, "set names gbk");
+        string charset = config->getString("mysql.charset", "gbk");
+        mysql_query(_conn, ("set names " + charset).c_str());
         LOG_INFO << "connect mysql success!";
     }
     else
@@ -57,8 +63,33 @@ MYSQL_RES *MySQL::query(string sql)
     return mysql_use_result(_conn);
 }
 
+// 获取预处理语句，同一连接上相同的SQL只预处理一次
+Statement *MySQL::prepare(const string &sql)
+{
+    auto it = _stmtCache.find(sql);
+    if (it != _stmtCache.end())
+    {
+        return it->second.get();
+    }
+
+    unique_ptr<Statement> stmt(new Statement(_conn));
+    if (!stmt->prepare(sql))
+    {
+        return nullptr;
+    }
+    Statement *result = stmt.get();
+    _stmtCache.emplace(sql, std::move(stmt));
+    return result;
+}
+
 // 获取连接
 MYSQL* MySQL::getConnection()
 {
     return _conn;
-}
\ No newline at end of file
+}
+
+// 检查连接是否可用
+bool MySQL::ping()
+{
+    return mysql_ping(_conn) == 0;
+}
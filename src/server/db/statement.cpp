@@ -0,0 +1,191 @@
+#include "statement.hpp"
+#include <muduo/base/Logging.h>
+#include <string.h>
+
+// 结果列缓冲区的初始大小，超过时在fetch中扩容
+static const unsigned long kInitColumnSize = 256;
+
+Statement::Statement(MYSQL *conn)
+    : _stmt(mysql_stmt_init(conn))
+{
+}
+
+Statement::~Statement()
+{
+    if (_stmt != nullptr)
+        mysql_stmt_close(_stmt);
+}
+
+// 预处理SQL语句，参数用?占位
+bool Statement::prepare(const string &sql)
+{
+    _sql = sql;
+    if (_stmt == nullptr || mysql_stmt_prepare(_stmt, sql.c_str(), sql.size()))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << sql << "预处理失败!" << (_stmt != nullptr ? mysql_stmt_error(_stmt) : "");
+        return false;
+    }
+
+    _params.resize(mysql_stmt_param_count(_stmt));
+    _paramBinds.resize(_params.size());
+    memset(_paramBinds.data(), 0, sizeof(MYSQL_BIND) * _paramBinds.size());
+
+    _columns.resize(mysql_stmt_field_count(_stmt));
+    _resultBinds.resize(_columns.size());
+    memset(_resultBinds.data(), 0, sizeof(MYSQL_BIND) * _resultBinds.size());
+    for (size_t i = 0; i < _columns.size(); ++i)
+    {
+        // 所有列都按字符串取回，由getInt/getString转换
+        Column &col = _columns[i];
+        col.buffer.resize(kInitColumnSize);
+        MYSQL_BIND &bind = _resultBinds[i];
+        bind.buffer_type = MYSQL_TYPE_STRING;
+        bind.buffer = col.buffer.data();
+        bind.buffer_length = col.buffer.size();
+        bind.length = &col.length;
+        bind.is_null = &col.isNull;
+        bind.error = &col.error;
+    }
+    return true;
+}
+
+// 绑定整数参数
+void Statement::bindInt(int index, long long value)
+{
+    Param &param = _params[index];
+    param.intValue = value;
+    MYSQL_BIND &bind = _paramBinds[index];
+    bind.buffer_type = MYSQL_TYPE_LONGLONG;
+    bind.buffer = &param.intValue;
+    bind.is_unsigned = false;
+}
+
+// 绑定字符串参数，按长度传递，不会被截断
+void Statement::bindString(int index, const string &value)
+{
+    Param &param = _params[index];
+    param.strValue = value;
+    param.length = param.strValue.size();
+    MYSQL_BIND &bind = _paramBinds[index];
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = const_cast<char *>(param.strValue.data());
+    bind.buffer_length = param.length;
+    bind.length = &param.length;
+}
+
+// 绑定字符串参数但不拷贝，value必须在execute之前保持有效
+void Statement::bindStringRef(int index, const string &value)
+{
+    Param &param = _params[index];
+    param.length = value.size();
+    MYSQL_BIND &bind = _paramBinds[index];
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = const_cast<char *>(value.data());
+    bind.buffer_length = param.length;
+    bind.length = &param.length;
+}
+
+// 执行语句
+bool Statement::execute()
+{
+    // 释放上一次执行缓存的结果集，语句可以重复执行
+    mysql_stmt_free_result(_stmt);
+
+    if ((!_paramBinds.empty() && mysql_stmt_bind_param(_stmt, _paramBinds.data())) ||
+        mysql_stmt_execute(_stmt))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << _sql << "执行失败!" << mysql_stmt_error(_stmt);
+        return false;
+    }
+
+    if (!_columns.empty())
+    {
+        // 结果全部缓存到客户端，连接可以立即执行其他语句
+        if (!bindResult() || mysql_stmt_store_result(_stmt))
+        {
+            LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                     << _sql << "读取结果失败!" << mysql_stmt_error(_stmt);
+            return false;
+        }
+    }
+    return true;
+}
+
+// 把结果列绑定到语句上
+bool Statement::bindResult()
+{
+    return !mysql_stmt_bind_result(_stmt, _resultBinds.data());
+}
+
+// 读取下一行结果
+bool Statement::fetch()
+{
+    int ret = mysql_stmt_fetch(_stmt);
+    if (ret == MYSQL_DATA_TRUNCATED)
+    {
+        // 有列超过了缓冲区，按实际长度扩容后重新取该列
+        bool resized = false;
+        for (size_t i = 0; i < _columns.size(); ++i)
+        {
+            Column &col = _columns[i];
+            if (!col.isNull && col.length > col.buffer.size())
+            {
+                col.buffer.resize(col.length);
+                MYSQL_BIND &bind = _resultBinds[i];
+                bind.buffer = col.buffer.data();
+                bind.buffer_length = col.buffer.size();
+                if (mysql_stmt_fetch_column(_stmt, &bind, i, 0))
+                {
+                    LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                             << _sql << "读取列失败!" << mysql_stmt_error(_stmt);
+                    return false;
+                }
+                resized = true;
+            }
+        }
+        // 缓冲区地址变了，重新绑定，后续行直接写入新的缓冲区
+        if (resized && !bindResult())
+        {
+            return false;
+        }
+        return true;
+    }
+    return ret == 0;
+}
+
+// 读取当前行第col列的整数值
+int Statement::getInt(int col) const
+{
+    return atoi(getString(col).c_str());
+}
+
+// 读取当前行第col列的64位整数值
+long long Statement::getInt64(int col) const
+{
+    return atoll(getString(col).c_str());
+}
+
+// 读取当前行第col列的字符串值，NULL返回空串
+string Statement::getString(int col) const
+{
+    const Column &column = _columns[col];
+    if (column.isNull)
+    {
+        return string();
+    }
+    return string(column.buffer.data(), column.length);
+}
+
+// 插入生成的自增主键
+unsigned long long Statement::insertId()
+{
+    return mysql_stmt_insert_id(_stmt);
+}
+
+// 受影响的行数
+unsigned long long Statement::affectedRows()
+{
+    return mysql_stmt_affected_rows(_stmt);
+}
@@ -1,8 +1,15 @@
 #include "chatserver.hpp"
 #include "chatservice.hpp"
+#include "config.hpp"
+#include "metrics.hpp"
+#include "statsserver.hpp"
+#include "connectionpool.hpp"
+#include "segmentofflinestore.hpp"
 #include <muduo/base/Logging.h>
 #include <iostream>
 #include <signal.h>
+#include <unistd.h>
+#include <limits.h>
 
 using namespace std;
 
@@ -16,23 +23,113 @@ void resetHandler(int)
 
 int main(int argc, char **argv)
 {
-    if (argc < 3)
+    // 命令行参数：[ip port] [--config=文件] [--key=value ...]，命令行中的配置覆盖配置文件
+    Config *config = Config::instance();
+    vector<string> positional;
+    config->parseArgs(argc, argv, positional);
+
+    if (positional.size() >= 2)
+    {
+        config->set("server.ip", positional[0]);
+        config->set("server.port", positional[1]);
+    }
+
+    // 没有指定配置文件时读取当前目录下的chatserver.conf（可以不存在）
+    // 文件中的配置不覆盖命令行中已经给出的配置
+    string configFile = config->getString("config", "chatserver.conf");
+    if (!config->load(configFile) && config->contains("config"))
+    {
+        cerr << "can not read config file " << configFile << endl;
+        exit(-1);
+    }
+    if (!config->contains("server.ip") || !config->contains("server.port"))
+    {
+        cerr << "command invalid! example: ./ChatServer 127.0.0.1 6000 [--config=chatserver.conf] [--key=value ...]" << endl;
+        exit(-1);
+    }
+
+    // 解析ip和port
+    string ip = config->getString("server.ip", "127.0.0.1");
+    int portArg = config->getInt("server.port", 6000);
+    if (portArg <= 0 || portArg > 65535)
     {
-        cerr << "command invalid! example: ./ChatServer 127.0.0.1 6000" << endl;
+        cerr << "invalid server.port " << config->getString("server.port", "") << endl;
         exit(-1);
     }
+    uint16_t port = static_cast<uint16_t>(portArg);
+    // 跨服务器路由方式：node按服务器订阅（默认），user按用户订阅
+    RouteMode routeMode = config->getString("server.route_mode", "node") == "user" ? ROUTE_PER_USER : ROUTE_PER_NODE;
 
-    // 解析通过命令行参数传递的ip和port
-    char *ip = argv[1];
-    uint16_t port = atoi(argv[2]);
+    // 本机在集群中的名字，用作本机的订阅通道和路由表中的值，集群中必须唯一
+    // 默认是“主机名:端口”；监听通配地址时多台服务器的ip:port可能完全相同，必须显式指定
+    string nodeId = config->getString("server.node_id", "");
+    if (nodeId.empty())
+    {
+        if (ip == "0.0.0.0" || ip == "::" || ip.empty())
+        {
+            cerr << "server.node_id is required when listening on a wildcard address " << ip << endl;
+            exit(-1);
+        }
+        char hostname[HOST_NAME_MAX + 1] = {0};
+        if (gethostname(hostname, sizeof(hostname) - 1) < 0 || hostname[0] == '\0')
+        {
+            cerr << "can not get hostname, set server.node_id" << endl;
+            exit(-1);
+        }
+        nodeId = string(hostname) + ":" + to_string(port);
+    }
+    LOG_INFO << "cluster node id: " << nodeId;
 
     signal(SIGINT, resetHandler);
 
     EventLoop loop;
     InetAddress addr(ip, port);
-    ChatServer server(&loop, addr, "ChatChat");
+    // 离线消息存储：mysql（默认）或segment（本机段文件，只适用于单台服务器）
+    if (config->getString("offline.store", "mysql") == "segment")
+    {
+        string dir = config->getString("offline.dir", "./offline");
+        ChatService::instance()->setOfflineStore(unique_ptr<OfflineStore>(new SegmentOfflineStore(dir)));
+    }
+    // 先创建服务器，业务线程池交给ChatService后再订阅Redis通道，订阅到的消息可以直接交给业务线程
+    ChatServer server(&loop, addr, "ChatChat",
+                      config->getInt("server.worker_threads", 8, 1, INT_MAX),
+                      config->getInt("server.worker_queue", 65536, 1, INT_MAX),
+                      config->getInt("server.io_threads", 0, 0, INT_MAX),
+                      config->getBool("server.pin_cpu", false),
+                      config->getBool("server.reuse_port", false),
+                      config->getInt("server.max_message_len", ChatCodec::kDefaultMaxMessageLen, 1, INT_MAX));
+    ChatService::instance()->init(nodeId, routeMode);
+
+    // 定期把运行指标写到日志中，0表示不输出
+    double metricsInterval = config->getDouble("metrics.log_interval", 0);
+    if (metricsInterval > 0)
+    {
+        loop.runEvery(metricsInterval, []()
+                      { LOG_INFO << "metrics:\n" << Metrics::instance()->report(); });
+    }
 
     server.start();
+
+    // 可选的运行状态查询端口，在自己的事件循环线程中服务，0表示不开启
+    unique_ptr<StatsServer> stats;
+    int statsPort = config->getInt("metrics.port", 0, 0, 65535);
+    if (statsPort > 0)
+    {
+        InetAddress statsAddr(config->getString("metrics.ip", ip), static_cast<uint16_t>(statsPort));
+        stats.reset(new StatsServer(statsAddr, "ChatChatStats"));
+        stats->addStats(std::bind(&ChatServer::stats, &server, std::placeholders::_1));
+        stats->addStats(std::bind(&ChatService::stats, ChatService::instance(), std::placeholders::_1));
+        stats->addStats([](vector<pair<string, long long>> &values)
+                        {
+            ConnectionPool *pool = ConnectionPool::instance();
+            int total = pool->totalSize();
+            int idle = pool->idleSize();
+            values.emplace_back("mysql.pool.total", total);
+            values.emplace_back("mysql.pool.idle", idle);
+            values.emplace_back("mysql.pool.busy", total - idle); });
+        stats->start();
+    }
+
     loop.loop();
 
     return 0;
@@ -0,0 +1,222 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+// 只有所属线程写，普通的读后写就够了，不需要原子的读改写
+static inline void increase(atomic<uint64_t> &value, uint64_t n)
+{
+    value.store(value.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// 获取指标单例对象
+Metrics *Metrics::instance()
+{
+    static Metrics metrics;
+    return &metrics;
+}
+
+// 注册（或查找已注册的）直方图
+int Metrics::histogram(const string &name)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto it = find(_histogramNames.begin(), _histogramNames.end(), name);
+    if (it != _histogramNames.end())
+    {
+        return static_cast<int>(it - _histogramNames.begin());
+    }
+    if (_histogramNames.size() >= kMaxHistograms)
+    {
+        return -1;
+    }
+    _histogramNames.push_back(name);
+    return static_cast<int>(_histogramNames.size()) - 1;
+}
+
+// 注册（或查找已注册的）计数器
+int Metrics::counter(const string &name)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto it = find(_counterNames.begin(), _counterNames.end(), name);
+    if (it != _counterNames.end())
+    {
+        return static_cast<int>(it - _counterNames.begin());
+    }
+    if (_counterNames.size() >= kMaxCounters)
+    {
+        return -1;
+    }
+    _counterNames.push_back(name);
+    return static_cast<int>(_counterNames.size()) - 1;
+}
+
+// 当前线程的数据，第一次调用时分配并登记
+Metrics::ThreadData *Metrics::threadData()
+{
+    thread_local ThreadData *data = nullptr;
+    if (data == nullptr)
+    {
+        // 值初始化把所有原子量清零
+        data = new ThreadData();
+        lock_guard<mutex> lock(_mutex);
+        _threads.push_back(data);
+    }
+    return data;
+}
+
+// 在直方图中记录一次耗时
+void Metrics::record(int id, uint64_t micros)
+{
+    if (id < 0 || id >= kMaxHistograms)
+    {
+        return;
+    }
+    ThreadData *data = threadData();
+    HistogramData *histogram = data->histograms[id].load(memory_order_relaxed);
+    if (histogram == nullptr)
+    {
+        histogram = new HistogramData();
+        // 读取线程可能同时在遍历，发布时保证它看到清零后的数据
+        data->histograms[id].store(histogram, memory_order_release);
+    }
+    increase(histogram->count, 1);
+    increase(histogram->sum, micros);
+    increase(histogram->buckets[bucketOf(micros)], 1);
+    if (micros > histogram->max.load(memory_order_relaxed))
+    {
+        histogram->max.store(micros, memory_order_relaxed);
+    }
+}
+
+// 计数器增加n
+void Metrics::add(int id, uint64_t n)
+{
+    if (id < 0 || id >= kMaxCounters)
+    {
+        return;
+    }
+    increase(threadData()->counters[id], n);
+}
+
+// 值所在的桶：小于16的值每个值一个桶，之后每个2的幂区间分成16个子桶
+int Metrics::bucketOf(uint64_t micros)
+{
+    if (micros < static_cast<uint64_t>(kSubBucketCount))
+    {
+        return static_cast<int>(micros);
+    }
+    int exponent = 63 - __builtin_clzll(micros);
+    if (exponent >= kMaxExponent)
+    {
+        return kBucketCount - 1;
+    }
+    int shift = exponent - kSubBucketBits;
+    int sub = static_cast<int>(micros >> shift) - kSubBucketCount;
+    return kSubBucketCount + shift * kSubBucketCount + sub;
+}
+
+// 桶的上界（包含）
+uint64_t Metrics::upperBoundOf(int bucket)
+{
+    if (bucket < kSubBucketCount)
+    {
+        return bucket;
+    }
+    int shift = (bucket - kSubBucketCount) / kSubBucketCount;
+    int sub = (bucket - kSubBucketCount) % kSubBucketCount;
+    return ((static_cast<uint64_t>(kSubBucketCount + sub + 1)) << shift) - 1;
+}
+
+// 百分位数，返回所在桶的上界，不超过记录到的最大值
+uint64_t Metrics::HistogramSnapshot::percentile(double p) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * count + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return std::min(upperBoundOf(static_cast<int>(i)), max);
+        }
+    }
+    return max;
+}
+
+// 所有直方图的合计快照，记录中的线程可能让各项之间略有出入
+vector<Metrics::HistogramSnapshot> Metrics::histograms() const
+{
+    lock_guard<mutex> lock(_mutex);
+    vector<HistogramSnapshot> snapshots(_histogramNames.size());
+    for (size_t id = 0; id < _histogramNames.size(); ++id)
+    {
+        HistogramSnapshot &snapshot = snapshots[id];
+        snapshot.name = _histogramNames[id];
+        snapshot.count = snapshot.sum = snapshot.max = 0;
+        snapshot.buckets.assign(kBucketCount, 0);
+        for (ThreadData *data : _threads)
+        {
+            HistogramData *histogram = data->histograms[id].load(memory_order_acquire);
+            if (histogram == nullptr)
+            {
+                continue;
+            }
+            snapshot.count += histogram->count.load(memory_order_relaxed);
+            snapshot.sum += histogram->sum.load(memory_order_relaxed);
+            snapshot.max = std::max(snapshot.max, histogram->max.load(memory_order_relaxed));
+            for (int i = 0; i < kBucketCount; ++i)
+            {
+                snapshot.buckets[i] += histogram->buckets[i].load(memory_order_relaxed);
+            }
+        }
+    }
+    return snapshots;
+}
+
+// 所有计数器的合计
+vector<pair<string, uint64_t>> Metrics::counters() const
+{
+    lock_guard<mutex> lock(_mutex);
+    vector<pair<string, uint64_t>> values;
+    values.reserve(_counterNames.size());
+    for (size_t id = 0; id < _counterNames.size(); ++id)
+    {
+        uint64_t value = 0;
+        for (ThreadData *data : _threads)
+        {
+            value += data->counters[id].load(memory_order_relaxed);
+        }
+        values.emplace_back(_counterNames[id], value);
+    }
+    return values;
+}
+
+// 所有指标的文本报告
+// 计数器：名字 值
+// 直方图：名字 count=次数 mean=平均 p50=... p90=... p99=... p999=... max=...（微秒）
+string Metrics::report() const
+{
+    ostringstream out;
+    for (const auto &counter : counters())
+    {
+        out << counter.first << " " << counter.second << "\n";
+    }
+    for (const HistogramSnapshot &snapshot : histograms())
+    {
+        out << snapshot.name
+            << " count=" << snapshot.count
+            << " mean=" << (snapshot.count == 0 ? 0 : snapshot.sum / snapshot.count)
+            << " p50=" << snapshot.percentile(50)
+            << " p90=" << snapshot.percentile(90)
+            << " p99=" << snapshot.percentile(99)
+            << " p999=" << snapshot.percentile(99.9)
+            << " max=" << snapshot.max << "\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,172 @@
+#include "statsserver.hpp"
+#include "metrics.hpp"
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <unordered_map>
+#include <sstream>
+#include <future>
+
+using namespace std;
+using namespace placeholders;
+
+// 请求头最长长度，超过时直接关闭连接
+static const size_t kMaxRequestLen = 8192;
+// 速率的采样间隔（秒）
+static const double kSampleInterval = 1.0;
+
+StatsServer::StatsServer(const InetAddress &listenAddr, const string &name)
+    : _listenAddr(listenAddr),
+      _name(name),
+      _loopThread(EventLoopThread::ThreadInitCallback(), name)
+{
+}
+
+// TcpServer只能在自己的loop线程中析构，交给查询端口的线程销毁后再停止该线程
+StatsServer::~StatsServer()
+{
+    if (!_server)
+    {
+        return;
+    }
+    std::promise<void> destroyed;
+    _server->getLoop()->runInLoop([this, &destroyed]()
+                                  {
+        _server.reset();
+        destroyed.set_value(); });
+    destroyed.get_future().wait();
+}
+
+// 启动查询端口的事件循环线程并开始监听
+void StatsServer::start()
+{
+    EventLoop *loop = _loopThread.startLoop();
+    // TcpServer只能在自己的loop线程中启动，在查询端口的线程中创建并开始监听，等它监听后再返回
+    std::promise<void> listening;
+    loop->runInLoop([this, loop, &listening]()
+                    {
+        _server.reset(new TcpServer(loop, _listenAddr, _name));
+        _server->setConnectionCallback(std::bind(&StatsServer::onConnection, this, _1));
+        _server->setMessageCallback(std::bind(&StatsServer::onMessage, this, _1, _2, _3));
+        _server->start();
+        listening.set_value(); });
+    listening.get_future().wait();
+
+    // 采样只在该线程中进行，和处理请求不会并发
+    loop->runInLoop([this]()
+                    { sample(); });
+    loop->runEvery(kSampleInterval, [this]()
+                   { sample(); });
+    LOG_INFO << "stats server listening on " << _listenAddr.toIpPort();
+}
+
+// 每秒采样一次Metrics，算出各指标在最近一秒内的速率
+void StatsServer::sample()
+{
+    vector<pair<string, unsigned long long>> counts;
+    Metrics *metrics = Metrics::instance();
+    for (const Metrics::HistogramSnapshot &snapshot : metrics->histograms())
+    {
+        counts.emplace_back(snapshot.name, snapshot.count);
+    }
+    for (const auto &counter : metrics->counters())
+    {
+        counts.emplace_back(counter.first, counter.second);
+    }
+
+    // 指标只增不删，新注册的指标排在后面，按名字对应上一次的值
+    unordered_map<string, unsigned long long> last(_lastCounts.begin(), _lastCounts.end());
+    _rates.clear();
+    for (const auto &count : counts)
+    {
+        auto it = last.find(count.first);
+        if (it != last.end())
+        {
+            _rates.emplace_back(count.first, (count.second - it->second) / kSampleInterval);
+        }
+    }
+    _lastCounts.swap(counts);
+}
+
+void StatsServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        LOG_DEBUG << "stats query from " << conn->peerAddress().toIpPort();
+    }
+}
+
+// 收到完整的请求后回复报告并关闭连接
+// HTTP请求等到空行（请求头结束），其他请求等到第一行结束
+void StatsServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time)
+{
+    string request(buf->peek(), buf->readableBytes());
+    bool http = request.compare(0, 4, "GET ") == 0 || request.compare(0, 5, "HEAD ") == 0;
+    bool complete = http ? (request.find("\r\n\r\n") != string::npos || request.find("\n\n") != string::npos)
+                         : request.find('\n') != string::npos;
+    if (!complete)
+    {
+        if (request.size() > kMaxRequestLen)
+        {
+            conn->shutdown();
+        }
+        return;
+    }
+    buf->retrieveAll();
+
+    if (!http)
+    {
+        conn->send(report());
+        conn->shutdown();
+        return;
+    }
+
+    // 请求行：方法 路径 版本
+    size_t begin = request.find(' ') + 1;
+    string path = request.substr(begin, request.find_first_of(" \r\n", begin) - begin);
+    string status = "200 OK";
+    string body;
+    if (path == "/" || path == "/metrics" || path.compare(0, 9, "/metrics?") == 0)
+    {
+        body = report();
+    }
+    else
+    {
+        status = "404 Not Found";
+        body = "not found, try /metrics\n";
+    }
+
+    string response = "HTTP/1.0 " + status + "\r\n"
+                      "Content-Type: text/plain; charset=utf-8\r\n"
+                      "Content-Length: " + to_string(body.size()) + "\r\n"
+                      "Connection: close\r\n\r\n";
+    if (request.compare(0, 5, "HEAD ") != 0)
+    {
+        response += body;
+    }
+    conn->send(response);
+    conn->shutdown();
+}
+
+// 生成完整的文本报告：状态值、每秒速率、全部指标
+string StatsServer::report()
+{
+    vector<pair<string, long long>> stats;
+    for (const StatsCallback &callback : _callbacks)
+    {
+        callback(stats);
+    }
+
+    ostringstream out;
+    for (const auto &stat : stats)
+    {
+        out << stat.first << " " << stat.second << "\n";
+    }
+    out.setf(ios::fixed);
+    out.precision(1);
+    for (const auto &rate : _rates)
+    {
+        out << "rate." << rate.first << " " << rate.second << "\n";
+    }
+    out << Metrics::instance()->report();
+    return out.str();
+}
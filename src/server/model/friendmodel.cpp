@@ -1,46 +1,54 @@
 #include "friendmodel.hpp"
-#include "db.h"
+#include "connectionpool.hpp"
+#include "metrics.hpp"
 
 void FriendModel::insert(int userId, int friendId)
 {
-    // 组织sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into friend values(%d, %d)", userId, friendId);
-
-    MySQL mysql;
-    if (mysql.connect())
+    METRICS_SCOPE("model.friend.insert");
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        Statement *stmt = mysql->prepare("insert into friend values(?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, userId);
+            stmt->bindInt(1, friendId);
+            stmt->execute();
+        }
     }
 }
 
 vector<User> FriendModel::query(int userId)
 {
-    // 1.组装sql语句
-    // User表和Friend联合查询
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "select a.id, a.name, a.state from user a inner join friend b on b.friendid = a.id where b.userid = %d", userId);
+    METRICS_SCOPE("model.friend.query");
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        return vector<User>();
+    }
+    return query(*mysql, userId);
+}
 
+vector<User> FriendModel::query(MySQL &mysql, int userId)
+{
     vector<User> vec;
-    MySQL mysql;
-    if (mysql.connect())
+    // User表和Friend联合查询
+    Statement *stmt = mysql.prepare("select a.id, a.name, a.state from user a inner join friend b on b.friendid = a.id where b.userid = ?");
+    if (stmt != nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        stmt->bindInt(0, userId);
+        if (stmt->execute())
         {
             // 把userid用户的所有好友信息放入vec中返回
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            while (stmt->fetch())
             {
                 User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
+                user.setId(stmt->getInt(0));
+                user.setName(stmt->getString(1));
+                user.setState(stmt->getString(2));
                 vec.push_back(user);
             }
-            mysql_free_result(res);
-            return vec;
         }
     }
     return vec;
-}
\ No newline at end of file
+}
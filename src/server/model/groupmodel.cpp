@@ -1,21 +1,24 @@
 #include "groupmodel.hpp"
-#include "db.h"
+#include "connectionpool.hpp"
+#include "metrics.hpp"
 
 // 创建群组（设置群组名字和描述）
 bool GroupModel::createGroup(Group &group)
 {
-    // insert into allgroup(groupname, groupdesc) values('chat-server', 'test for create group2');
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into allgroup(groupname, groupdesc) values('%s', '%s')",
-             group.getName().c_str(), group.getDesc().c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    METRICS_SCOPE("model.group.create");
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        if (mysql.update(sql))
+        Statement *stmt = mysql->prepare("insert into allgroup(groupname, groupdesc) values(?, ?)");
+        if (stmt != nullptr)
         {
-            group.setId(mysql_insert_id(mysql.getConnection()));
-            return true;
+            stmt->bindString(0, group.getName());
+            stmt->bindString(1, group.getDesc());
+            if (stmt->execute())
+            {
+                group.setId(stmt->insertId());
+                return true;
+            }
         }
     }
 
@@ -25,98 +28,117 @@ bool GroupModel::createGroup(Group &group)
 // 加入群组（用户ID 加入群组ID 在群组角色）
 void GroupModel::addGroup(int userid, int groupid, string role)
 {
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into groupuser values(%d, %d, '%s')",
-             groupid, userid, role.c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    METRICS_SCOPE("model.group.add");
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        Statement *stmt = mysql->prepare("insert into groupuser values(?, ?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, groupid);
+            stmt->bindInt(1, userid);
+            stmt->bindString(2, role);
+            stmt->execute();
+        }
     }
 }
 
 // 查询用户所在群组信息
 vector<Group> GroupModel::queryGroups(int userid)
+{
+    METRICS_SCOPE("model.group.query_groups");
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        return vector<Group>();
+    }
+    return queryGroups(*mysql, userid);
+}
+
+vector<Group> GroupModel::queryGroups(MySQL &mysql, int userid)
 {
     /**
-     * // TODO:MySQL联表查询
-     * 1. 先根据userid对groupuser表和allgroup表进行联合查询，查出该用户所属的群组信息
-     * 2. 再根据群组信息，查询属于该群组的所有用户的userid，并且和user表进行多表联合查询，查出用户的详细信息
+     * 一条语句查出所有群组和成员数，成员列表由客户端按需分页查询
+     * 1. c: userid所在的群组
+     * 2. g: 群组信息，m: 这些群组的全部成员关系，只统计个数
      */
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "select a.id,a.groupname,a.groupdesc from allgroup a inner join \
-        groupuser b on a.id = b.groupid where b.userid=%d",
-             userid);
-
     vector<Group> groupVec;
+    Statement *stmt = mysql.prepare("select g.id,g.groupname,g.groupdesc,count(*) "
+                                    "from groupuser c inner join allgroup g on g.id = c.groupid "
+                                    "inner join groupuser m on m.groupid = c.groupid "
+                                    "where c.userid = ? group by g.id,g.groupname,g.groupdesc");
+    if (stmt == nullptr)
+    {
+        return groupVec;
+    }
 
-    MySQL mysql;
-    if (mysql.connect())
+    stmt->bindInt(0, userid);
+    if (stmt->execute())
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        while (stmt->fetch())
         {
-            MYSQL_ROW row;
-            // 查出userid所有的群组信息
-            while ((row = mysql_fetch_row(res)) != nullptr)
-            {
-                Group group;
-                group.setId(atoi(row[0]));
-                group.setName(row[1]);
-                group.setDesc(row[2]);
-                groupVec.push_back(group);
-            }
-            mysql_free_result(res);
+            Group group(stmt->getInt(0), stmt->getString(1), stmt->getString(2));
+            group.setMemberCount(stmt->getInt(3));
+            groupVec.push_back(group);
         }
     }
+    return groupVec;
+}
 
-    // 查询群组的用户信息
-    for (Group &group : groupVec)
+// 根据指定的groupid查询群组全部成员的id列表，用于加载群组成员缓存
+vector<int> GroupModel::queryGroupMembers(int groupid)
+{
+    METRICS_SCOPE("model.group.query_members");
+    vector<int> idVec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        snprintf(sql, sizeof(sql), "select a.id,a.name,a.state,b.grouprole from user a \
-            inner join groupuser b on b.userid = a.id where b.groupid=%d",
-                 group.getId());
-
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        Statement *stmt = mysql->prepare("select userid from groupuser where groupid = ?");
+        if (stmt != nullptr)
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            stmt->bindInt(0, groupid);
+            if (stmt->execute())
             {
-                GroupUser user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
-                user.setRole(row[3]);
-                group.getUsers().push_back(user);
+                while (stmt->fetch())
+                {
+                    idVec.push_back(stmt->getInt(0));
+                }
             }
-            mysql_free_result(res);
         }
     }
-    return groupVec;
+    return idVec;
 }
 
-// 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
-vector<int> GroupModel::queryGroupUsers(int userid, int groupid)
+// 分页查询群组成员的详细信息
+// 按成员id翻页，每页都沿(groupid, userid)索引定位，和页码无关
+vector<GroupUser> GroupModel::queryMemberPage(int groupid, int afterUserid, int limit)
 {
-    char sql[1024] = {0};
-    sprintf(sql, "select userid from groupuser where groupid = %d and userid != %d", groupid, userid);
-
-    vector<int> idVec;
-    MySQL mysql;
-    if (mysql.connect())
+    METRICS_SCOPE("model.group.query_member_page");
+    vector<GroupUser> userVec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        Statement *stmt = mysql->prepare("select a.id,a.name,a.state,b.grouprole from groupuser b "
+                                         "inner join user a on a.id = b.userid "
+                                         "where b.groupid = ? and b.userid > ? order by b.userid limit ?");
+        if (stmt != nullptr)
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            stmt->bindInt(0, groupid);
+            stmt->bindInt(1, afterUserid);
+            stmt->bindInt(2, limit);
+            if (stmt->execute())
             {
-                idVec.push_back(atoi(row[0]));
+                while (stmt->fetch())
+                {
+                    GroupUser user;
+                    user.setId(stmt->getInt(0));
+                    user.setName(stmt->getString(1));
+                    user.setState(stmt->getString(2));
+                    user.setRole(stmt->getString(3));
+                    userVec.push_back(user);
+                }
             }
-            mysql_free_result(res);
         }
     }
-    return idVec;
-}
\ No newline at end of file
+    return userVec;
+}
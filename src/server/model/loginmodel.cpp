@@ -0,0 +1,18 @@
+#include "loginmodel.hpp"
+#include "connectionpool.hpp"
+#include "metrics.hpp"
+
+// 加载userid的好友和群组
+LoginSnapshot LoginModel::load(int userid)
+{
+    METRICS_SCOPE("model.login.load");
+    LoginSnapshot snapshot;
+    // 只借出一次连接，两个查询之间不再经过连接池
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        snapshot.friends = _friendModel.query(*mysql, userid);
+        snapshot.groups = _groupModel.queryGroups(*mysql, userid);
+    }
+    return snapshot;
+}
@@ -1,57 +1,45 @@
 #include "offlinemessagemodel.hpp"
-#include "db.h"
+#include "mysqlofflinestore.hpp"
+#include "metrics.hpp"
 
-// 存储用户的离线消息
-void OfflineMsgModel::insert(int userId, string msg)
+OfflineMsgModel::OfflineMsgModel()
+    : _store(new MySQLOfflineStore())
 {
-    // 组织sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into offlinemessage values(%d, '%s')", userId, msg.c_str());
+}
 
-    MySQL mysql;
-    if (mysql.connect())
-    {
-        mysql.update(sql);
-    }
+// 更换离线消息的存储
+void OfflineMsgModel::setStore(unique_ptr<OfflineStore> store)
+{
+    _store = std::move(store);
 }
 
-// 删除用户的离线消息
-void OfflineMsgModel::remove(int userId)
+// 存储用户的离线消息
+void OfflineMsgModel::insert(int userId, string msg)
 {
-    // 组织sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "delete from offlinemessage where userid = %d", userId);
+    METRICS_SCOPE("model.offline.insert");
+    _store->insert(userId, msg);
+}
 
-    MySQL mysql;
-    if (mysql.connect())
+// 批量存储多个用户的同一条离线消息
+void OfflineMsgModel::insert(const vector<int> &userIds, const string &msg)
+{
+    METRICS_SCOPE("model.offline.insert_batch");
+    if (!userIds.empty())
     {
-        mysql.update(sql);
+        _store->insert(userIds, msg);
     }
 }
 
-// 查询用户的离线消息
-vector<string> OfflineMsgModel::query(int userId)
+// 删除用户已经确认收到的离线消息
+void OfflineMsgModel::remove(int userId, const vector<long long> &ids)
 {
-    // 组织sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "select message from offlinemessage where userid = %d", userId);
+    METRICS_SCOPE("model.offline.remove");
+    _store->remove(userId, ids);
+}
 
-    vector<string> vec;
-    MySQL mysql;
-    if (mysql.connect())
-    {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
-        {
-            // 把userid用户的所有离线消息放入vec中返回
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
-            {
-                vec.push_back(row[0]);
-            }
-            mysql_free_result(res);
-            return vec;
-        }
-    }
-    return vec;
+// 分页查询用户的离线消息
+vector<OfflineMessage> OfflineMsgModel::query(int userId, long long afterId, int limit, size_t maxBytes)
+{
+    METRICS_SCOPE("model.offline.query");
+    return _store->query(userId, afterId, limit, maxBytes);
 }
@@ -1,23 +1,28 @@
 #include "usermodel.hpp"
-#include "db.h"
+#include "connectionpool.hpp"
+#include "metrics.hpp"
 #include <iostream>
 
 // User表的增加方法（注册）
 bool UserModel::insert(User &user)
 {
-    // 组装sql语句
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "insert into user(name, password, state) values('%s', '%s', '%s')", user.getName().c_str(), user.getPassword().c_str(), user.getState().c_str());
-
-    // 连接Mysql数据库
-    MySQL mysql;
-    if (mysql.connect())
+    METRICS_SCOPE("model.user.insert");
+    // 从连接池借出连接，出作用域自动归还
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        if (mysql.update(sql))
+        Statement *stmt = mysql->prepare("insert into user(name, password, state) values(?, ?, ?)");
+        if (stmt != nullptr)
         {
-            // 获取插入成功的用户数据生成的主键id
-            user.setId(mysql_insert_id(mysql.getConnection()));
-            return true;
+            stmt->bindString(0, user.getName());
+            stmt->bindString(1, user.getPassword());
+            stmt->bindString(2, user.getState());
+            if (stmt->execute())
+            {
+                // 获取插入成功的用户数据生成的主键id
+                user.setId(stmt->insertId());
+                return true;
+            }
         }
     }
     return false;
@@ -26,27 +31,23 @@ bool UserModel::insert(User &user)
 // 根据用户号码查询用户信息
 User UserModel::query(int id)
 {
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "select * from user where id = %d", id);
-
-    MySQL mysql;
-    if (mysql.connect())
+    METRICS_SCOPE("model.user.query");
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        Statement *stmt = mysql->prepare("select id, name, password, state from user where id = ?");
+        if (stmt != nullptr)
         {
-            // 读取结果集中的一条记录（一行），同时当前记录指针会后移
+            stmt->bindInt(0, id);
             // 这里根据主键查询，fetch只会得到一行
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row != nullptr)
+            if (stmt->execute() && stmt->fetch())
             {
                 // 生成一个User对象，填入信息
                 User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setPassword(row[2]);
-                user.setState(row[3]);
-                mysql_free_result(res);
+                user.setId(stmt->getInt(0));
+                user.setName(stmt->getString(1));
+                user.setPassword(stmt->getString(2));
+                user.setState(stmt->getString(3));
                 return user;
             }
         }
@@ -58,15 +59,16 @@ User UserModel::query(int id)
 // 更新用户的状态信息
 bool UserModel::updateState(User user)
 {
-    char sql[1024] = {0};
-    snprintf(sql, sizeof(sql), "update user set state = '%s' where id = %d", user.getState().c_str(), user.getId());
-
-    MySQL mysql;
-    if (mysql.connect())
+    METRICS_SCOPE("model.user.update_state");
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        if (mysql.update(sql))
+        Statement *stmt = mysql->prepare("update user set state = ? where id = ?");
+        if (stmt != nullptr)
         {
-            return true;
+            stmt->bindString(0, user.getState());
+            stmt->bindInt(1, user.getId());
+            return stmt->execute();
         }
     }
     return false;
@@ -75,11 +77,10 @@ bool UserModel::updateState(User user)
 // 重置用户的状态信息
 void UserModel::resetState()
 {
-    char sql[1024] = "update user set state = 'offline' where state = 'online'";
-
-    MySQL mysql;
-    if (mysql.connect())
+    METRICS_SCOPE("model.user.reset_state");
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        mysql->update("update user set state = 'offline' where state = 'online'");
     }
 }
@@ -0,0 +1,146 @@
+#include "userstatewriter.hpp"
+#include "connectionpool.hpp"
+#include "metrics.hpp"
+#include <muduo/base/Logging.h>
+#include <algorithm>
+
+UserStateWriter::UserStateWriter(int interval, size_t maxPending)
+    : _interval(interval),
+      _maxPending(maxPending),
+      _stop(false)
+{
+    _thread = thread(std::bind(&UserStateWriter::runInThread, this));
+}
+
+UserStateWriter::~UserStateWriter()
+{
+    stop();
+}
+
+// 记录用户的最新状态，不访问数据库
+void UserStateWriter::setState(int userid, bool online)
+{
+    bool full = false;
+    {
+        lock_guard<mutex> lock(_mutex);
+        _pending[userid] = online;
+        full = _pending.size() >= _maxPending;
+    }
+    if (full)
+    {
+        _cv.notify_one();
+    }
+}
+
+// 写入所有积压的状态后停止后台线程
+void UserStateWriter::stop()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_stop)
+        {
+            return;
+        }
+        _stop = true;
+    }
+    _cv.notify_one();
+    // 后台线程退出前会写入剩余的状态
+    _thread.join();
+}
+
+// 后台线程的主循环：等到间隔到期或积压过多，取走全部积压后在锁外写入
+// 写入失败的状态放回积压，不覆盖期间记下的新状态；失败后等满一个间隔再重试，不因积压过多反复重试
+// 停止前最后一次写入失败时只能丢弃，reset随后会把所有用户置为offline
+void UserStateWriter::runInThread()
+{
+    unordered_map<int, bool> pending;
+    bool stop = false;
+    bool failed = false;
+    while (!stop)
+    {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _cv.wait_for(lock, chrono::milliseconds(_interval), [this, failed]()
+                         { return _stop || (!failed && _pending.size() >= _maxPending); });
+            pending.swap(_pending);
+            stop = _stop;
+        }
+        flush(pending);
+        failed = !pending.empty();
+        if (failed && !stop)
+        {
+            lock_guard<mutex> lock(_mutex);
+            for (const auto &state : pending)
+            {
+                _pending.emplace(state.first, state.second);
+            }
+        }
+        else if (failed)
+        {
+            LOG_ERROR << "drop " << pending.size() << " user states on stop: write failed";
+        }
+        pending.clear();
+    }
+}
+
+// 把一批状态写入数据库，状态相同的用户合并成一条语句
+void UserStateWriter::flush(unordered_map<int, bool> &pending)
+{
+    if (pending.empty())
+    {
+        return;
+    }
+    METRICS_SCOPE("model.user_state.flush");
+
+    vector<int> online, offline;
+    for (const auto &state : pending)
+    {
+        (state.second ? online : offline).push_back(state.first);
+    }
+    size_t written = update("online", online);
+    for (size_t i = 0; i < written; ++i)
+    {
+        pending.erase(online[i]);
+    }
+    written = update("offline", offline);
+    for (size_t i = 0; i < written; ++i)
+    {
+        pending.erase(offline[i]);
+    }
+}
+
+// 把ids的状态更新为state，id都是整数，直接拼进语句
+size_t UserStateWriter::update(const char *state, const vector<int> &ids)
+{
+    if (ids.empty())
+    {
+        return 0;
+    }
+
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        LOG_ERROR << "write " << ids.size() << " user states failed: no mysql connection, retry later";
+        return 0;
+    }
+    for (size_t begin = 0; begin < ids.size(); begin += kBatchSize)
+    {
+        size_t end = std::min(ids.size(), begin + kBatchSize);
+        string sql = string("update user set state = '") + state + "' where id in (";
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (i != begin)
+            {
+                sql += ',';
+            }
+            sql += to_string(ids[i]);
+        }
+        sql += ')';
+        if (!mysql->update(sql))
+        {
+            LOG_ERROR << "write " << ids.size() - begin << " user states failed, retry later";
+            return begin;
+        }
+    }
+    return ids.size();
+}
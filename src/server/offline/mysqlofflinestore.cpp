@@ -0,0 +1,147 @@
+#include "mysqlofflinestore.hpp"
+#include "connectionpool.hpp"
+
+// 批量插入时每条insert语句最多包含的行数
+static const size_t kBatchRows = 64;
+
+// 存储用户的离线消息
+void MySQLOfflineStore::insert(int userId, const string &msg)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        // 消息按长度绑定，不会被截断
+        Statement *stmt = mysql->prepare("insert into offlinemessage(userid, message) values(?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, userId);
+            stmt->bindString(1, msg);
+            stmt->execute();
+        }
+    }
+}
+
+// 批量存储多个用户的同一条离线消息
+void MySQLOfflineStore::insert(const vector<int> &userIds, const string &msg)
+{
+    if (userIds.empty())
+    {
+        return;
+    }
+
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        return;
+    }
+
+    for (size_t begin = 0; begin < userIds.size(); begin += kBatchRows)
+    {
+        // 每批一条多行insert，行数相同的语句在连接上只预处理一次
+        size_t rows = min(kBatchRows, userIds.size() - begin);
+        string sql = "insert into offlinemessage(userid, message) values(?, ?)";
+        for (size_t i = 1; i < rows; ++i)
+        {
+            sql += ",(?, ?)";
+        }
+
+        Statement *stmt = mysql->prepare(sql);
+        if (stmt == nullptr)
+        {
+            return;
+        }
+        for (size_t i = 0; i < rows; ++i)
+        {
+            stmt->bindInt(2 * i, userIds[begin + i]);
+            stmt->bindStringRef(2 * i + 1, msg);
+        }
+        stmt->execute();
+    }
+}
+
+// 删除用户已经确认的离线消息
+// 只按id删除发出过的消息，发送失败、连接中断或晚提交的消息下次登录还能取到
+void MySQLOfflineStore::remove(int userId, const vector<long long> &ids)
+{
+    if (ids.empty())
+    {
+        return;
+    }
+
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql)
+    {
+        return;
+    }
+
+    for (size_t begin = 0; begin < ids.size(); begin += kBatchRows)
+    {
+        // 每批一条语句，id个数相同的语句在连接上只预处理一次
+        size_t rows = min(kBatchRows, ids.size() - begin);
+        string sql = "delete from offlinemessage where userid = ? and id in (?";
+        for (size_t i = 1; i < rows; ++i)
+        {
+            sql += ", ?";
+        }
+        sql += ")";
+
+        Statement *stmt = mysql->prepare(sql);
+        if (stmt == nullptr)
+        {
+            return;
+        }
+        stmt->bindInt(0, userId);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            stmt->bindInt(i + 1, ids[begin + i]);
+        }
+        stmt->execute();
+    }
+}
+
+// 分页查询用户的离线消息
+// 沿(userid, id)索引从游标处开始取，每页的代价和已经取过多少页无关
+vector<OfflineMessage> MySQLOfflineStore::query(int userId, long long afterId, int limit, size_t maxBytes)
+{
+    vector<OfflineMessage> vec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        Statement *stmt = mysql->prepare("select id, message from offlinemessage "
+                                         "where userid = ? and id > ? order by id limit ?");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, userId);
+            stmt->bindInt(1, afterId);
+            stmt->bindInt(2, limit);
+            if (stmt->execute())
+            {
+                size_t bytes = 0;
+                while (bytes < maxBytes && stmt->fetch())
+                {
+                    OfflineMessage msg{stmt->getInt64(0), stmt->getString(1)};
+                    bytes += msg.message.size();
+                    vec.push_back(std::move(msg));
+                }
+            }
+        }
+    }
+    return vec;
+}
+
+// 未确认的离线消息总数
+// 取InnoDB统计信息中的估计行数，不扫描整张表，查询端口频繁读取也没有负担
+long long MySQLOfflineStore::backlog()
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        Statement *stmt = mysql->prepare("select table_rows from information_schema.tables "
+                                         "where table_schema = database() and table_name = 'offlinemessage'");
+        if (stmt != nullptr && stmt->execute() && stmt->fetch())
+        {
+            return stmt->getInt64(0);
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,326 @@
+#include "segmentofflinestore.hpp"
+#include <muduo/base/Logging.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
+
+static const uint32_t kMagic = 0x4C46464F; // "OFFL"
+static const uint32_t kVersion = 1;
+// 记录头：id 8字节 + 消息长度 4字节
+static const size_t kRecordHeaderLen = sizeof(int64_t) + sizeof(uint32_t);
+// 已确认的部分超过1MB且占文件一半以上时重写文件
+static const size_t kCompactBytes = 1024 * 1024;
+
+namespace
+{
+    // 只读映射整个段文件，析构时解除映射
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const string &path)
+            : _data(nullptr), _size(0)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                return;
+            }
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                void *addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                if (addr != MAP_FAILED)
+                {
+                    _data = static_cast<const char *>(addr);
+                    _size = st.st_size;
+                }
+            }
+            // 映射建立后文件描述符就可以关闭了
+            ::close(fd);
+        }
+
+        ~MappedFile()
+        {
+            if (_data != nullptr)
+            {
+                ::munmap(const_cast<char *>(_data), _size);
+            }
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        const char *data() const { return _data; }
+        size_t size() const { return _size; }
+
+    private:
+        const char *_data;
+        size_t _size;
+    };
+
+    // 读取记录头
+    void readRecord(const char *data, size_t pos, int64_t &id, uint32_t &len)
+    {
+        memcpy(&id, data + pos, sizeof(id));
+        memcpy(&len, data + pos + sizeof(id), sizeof(len));
+    }
+}
+
+SegmentOfflineStore::SegmentOfflineStore(const string &dir)
+    : _dir(dir)
+{
+    if (::mkdir(_dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        LOG_ERROR << "create offline store directory " << _dir << " failed: " << strerror(errno);
+    }
+}
+
+string SegmentOfflineStore::shardOf(int userId) const
+{
+    return _dir + "/" + to_string(static_cast<unsigned>(userId) & 0xff);
+}
+
+string SegmentOfflineStore::pathOf(int userId) const
+{
+    return shardOf(userId) + "/" + to_string(userId) + ".seg";
+}
+
+// 存储用户的离线消息
+void SegmentOfflineStore::insert(int userId, const string &msg)
+{
+    lock_guard<mutex> lock(lockOf(userId));
+    append(userId, msg);
+}
+
+// 批量存储多个用户的同一条离线消息，每个用户追加到自己的文件
+void SegmentOfflineStore::insert(const vector<int> &userIds, const string &msg)
+{
+    for (int userId : userIds)
+    {
+        lock_guard<mutex> lock(lockOf(userId));
+        append(userId, msg);
+    }
+}
+
+// 追加一条消息，调用方持有用户锁
+void SegmentOfflineStore::append(int userId, const string &msg)
+{
+    string path = pathOf(userId);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == ENOENT)
+    {
+        // 分片目录第一次使用时创建
+        ::mkdir(shardOf(userId).c_str(), 0755);
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    if (fd < 0)
+    {
+        LOG_ERROR << "open " << path << " failed: " << strerror(errno);
+        return;
+    }
+
+    struct stat st;
+    Header header;
+    if (::fstat(fd, &st) < 0)
+    {
+        LOG_ERROR << "stat " << path << " failed: " << strerror(errno);
+        ::close(fd);
+        return;
+    }
+    off_t size = st.st_size;
+    if (size < static_cast<off_t>(sizeof(Header)))
+    {
+        // 新文件（或者文件头没写完整）先写文件头
+        header = Header{kMagic, kVersion, 0, 0};
+        if (::ftruncate(fd, 0) < 0 || ::write(fd, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header)))
+        {
+            LOG_ERROR << "write " << path << " failed: " << strerror(errno);
+            ::close(fd);
+            return;
+        }
+        size = sizeof(Header);
+    }
+    else if (::pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) || header.magic != kMagic)
+    {
+        LOG_ERROR << "bad offline segment " << path;
+        ::close(fd);
+        return;
+    }
+
+    // 记录头和消息一次写入，id就是记录开始处的逻辑偏移
+    int64_t id = header.base + size;
+    uint32_t len = static_cast<uint32_t>(msg.size());
+    struct iovec iov[3];
+    iov[0].iov_base = &id;
+    iov[0].iov_len = sizeof(id);
+    iov[1].iov_base = &len;
+    iov[1].iov_len = sizeof(len);
+    iov[2].iov_base = const_cast<char *>(msg.data());
+    iov[2].iov_len = msg.size();
+    ssize_t n = ::writev(fd, iov, 3);
+    if (n != static_cast<ssize_t>(kRecordHeaderLen + msg.size()))
+    {
+        // 写了一半的记录截掉，不留下残缺的尾部
+        LOG_ERROR << "append " << path << " failed: " << strerror(errno);
+        ::ftruncate(fd, size);
+    }
+    ::close(fd);
+}
+
+// id正好落在一条完整记录上时返回该记录之后的文件内偏移
+size_t SegmentOfflineStore::recordEnd(const char *data, size_t size, int64_t base, long long id)
+{
+    if (id < base + static_cast<int64_t>(sizeof(Header)))
+    {
+        return 0;
+    }
+    size_t pos = id - base;
+    if (pos + kRecordHeaderLen > size)
+    {
+        return 0;
+    }
+    int64_t recordId = 0;
+    uint32_t len = 0;
+    readRecord(data, pos, recordId, len);
+    if (recordId != id || pos + kRecordHeaderLen + len > size)
+    {
+        return 0;
+    }
+    return pos + kRecordHeaderLen + len;
+}
+
+// 在映射的文件中找到第一条id大于afterId的记录
+size_t SegmentOfflineStore::findStart(const char *data, size_t size, int64_t base, long long afterId)
+{
+    // afterId通常是上一页最后一条记录的id，直接跳到该记录，核对记录中的id后跳过它
+    size_t end = recordEnd(data, size, base, afterId);
+    if (end != 0)
+    {
+        return end;
+    }
+
+    // 否则从头顺序跳过id不超过afterId的记录
+    int64_t id = 0;
+    uint32_t len = 0;
+    size_t pos = sizeof(Header);
+    while (pos + kRecordHeaderLen <= size)
+    {
+        readRecord(data, pos, id, len);
+        if (id > afterId || pos + kRecordHeaderLen + len > size)
+        {
+            break;
+        }
+        pos += kRecordHeaderLen + len;
+    }
+    return pos;
+}
+
+// 分页查询用户的离线消息
+vector<OfflineMessage> SegmentOfflineStore::query(int userId, long long afterId, int limit, size_t maxBytes)
+{
+    vector<OfflineMessage> vec;
+    lock_guard<mutex> lock(lockOf(userId));
+    MappedFile file(pathOf(userId));
+    if (file.size() < sizeof(Header))
+    {
+        return vec;
+    }
+
+    Header header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != kMagic)
+    {
+        return vec;
+    }
+
+    // 已确认的消息即使还没被压缩掉也不再返回
+    size_t pos = findStart(file.data(), file.size(), header.base, std::max<long long>(afterId, header.acked));
+    size_t bytes = 0;
+    while (static_cast<int>(vec.size()) < limit && bytes < maxBytes && pos + kRecordHeaderLen <= file.size())
+    {
+        int64_t id = 0;
+        uint32_t len = 0;
+        readRecord(file.data(), pos, id, len);
+        if (pos + kRecordHeaderLen + len > file.size())
+        {
+            break;
+        }
+        vec.push_back(OfflineMessage{id, string(file.data() + pos + kRecordHeaderLen, len)});
+        bytes += len;
+        pos += kRecordHeaderLen + len;
+    }
+    return vec;
+}
+
+// 删除用户已经确认收到的离线消息
+// 段文件中的id按追加顺序递增且没有空洞，确认的总是一段前缀，只需推进到最后一个id
+// 先推进文件头中的acked，已确认的部分足够大或者全部确认时再丢掉这段前缀
+void SegmentOfflineStore::remove(int userId, const vector<long long> &ids)
+{
+    if (ids.empty())
+    {
+        return;
+    }
+    long long upToId = ids.back();
+    lock_guard<mutex> lock(lockOf(userId));
+    string path = pathOf(userId);
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    Header header;
+    if (::pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+        header.magic != kMagic || upToId <= header.acked)
+    {
+        ::close(fd);
+        return;
+    }
+
+    // 只接受落在一条已有记录上的id，超过最后一条记录的acked会让之后追加的消息永远查不到
+    MappedFile file(path);
+    if (file.size() < sizeof(Header) || recordEnd(file.data(), file.size(), header.base, upToId) == 0)
+    {
+        LOG_ERROR << "ignore ack " << upToId << " of user " << userId << ": not a stored message id";
+        ::close(fd);
+        return;
+    }
+    header.acked = upToId;
+    ::pwrite(fd, &header.acked, sizeof(header.acked), offsetof(Header, acked));
+    size_t start = findStart(file.data(), file.size(), header.base, header.acked);
+    size_t delivered = start - sizeof(Header);
+    if (start >= file.size())
+    {
+        // 全部确认：先推进base再截断，保证之后追加的记录id仍然大于已确认的id
+        header.base += file.size() - sizeof(Header);
+        ::pwrite(fd, &header.base, sizeof(header.base), offsetof(Header, base));
+        ::ftruncate(fd, sizeof(Header));
+    }
+    else if (delivered >= kCompactBytes && delivered * 2 >= file.size())
+    {
+        // 把未确认的部分写到新文件再替换，同一用户的追加此时被用户锁挡住
+        string tmpPath = path + ".tmp";
+        int tmp = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (tmp >= 0)
+        {
+            Header compacted{kMagic, kVersion, header.base + static_cast<int64_t>(delivered), header.acked};
+            size_t remain = file.size() - start;
+            bool ok = ::write(tmp, &compacted, sizeof(compacted)) == static_cast<ssize_t>(sizeof(compacted)) &&
+                      ::write(tmp, file.data() + start, remain) == static_cast<ssize_t>(remain);
+            ::close(tmp);
+            if (!ok || ::rename(tmpPath.c_str(), path.c_str()) < 0)
+            {
+                LOG_ERROR << "compact " << path << " failed: " << strerror(errno);
+                ::unlink(tmpPath.c_str());
+            }
+        }
+    }
+    ::close(fd);
+}
@@ -0,0 +1,56 @@
+#include "packet.hpp"
+#include "public.hpp"
+
+// 取json中的整数字段，不存在或类型不对时返回0
+static int intField(const json &js, const char *key)
+{
+    auto it = js.find(key);
+    if (it != js.end() && it->is_number_integer())
+    {
+        return it->get<int>();
+    }
+    return 0;
+}
+
+// 由json对象生成消息，头部字段从json中提取
+Packet Packet::fromJson(json js)
+{
+    string payload = js.dump();
+    return fromJson(std::move(js), std::move(payload));
+}
+
+// 由json文本生成消息，保留原始文本作为载荷
+Packet Packet::fromJson(json js, string payload)
+{
+    int msgid = intField(js, "msgid");
+    int target = 0;
+    switch (msgid)
+    {
+    case ONE_CHAT_MSG:
+        target = intField(js, "toid");
+        break;
+    case ADD_GROUP_MSG:
+    case GROUP_CHAT_MSG:
+    case GROUP_MEMBERS_MSG:
+        target = intField(js, "groupid");
+        break;
+    default:
+        break;
+    }
+
+    Packet packet(msgid, intField(js, "id"), target, std::move(payload));
+    packet._body = std::move(js);
+    packet._parsed = true;
+    return packet;
+}
+
+// 载荷对应的json对象，二进制消息在第一次访问时才解析
+json &Packet::body()
+{
+    if (!_parsed)
+    {
+        _body = json::parse(_payload);
+        _parsed = true;
+    }
+    return _body;
+}
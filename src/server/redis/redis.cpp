@@ -1,178 +1,674 @@
 #include "redis.hpp"
+#include "metrics.hpp"
+#include <muduo/net/Channel.h>
 #include <iostream>
+#include <future>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
 
-Redis::Redis() : _publish_context(nullptr), _subscribe_context(nullptr)
+// 同步等待命令结果的超时时间
+static const chrono::seconds kSyncTimeout(3);
+// 发布批处理的默认参数：最多攒128条，最多等待1毫秒
+static const size_t kDefaultBatchMaxCount = 128;
+static const double kDefaultBatchWindow = 0.001;
+// 断线重连的等待间隔（秒），每次失败翻倍直到上限
+static const double kMinReconnectDelay = 0.5;
+static const double kMaxReconnectDelay = 30;
+
+namespace
+{
+    // hiredis异步上下文和muduo Channel之间的适配器
+    // hiredis通过ev中的钩子告诉我们需要关注哪些读写事件，事件发生后再回调hiredis处理
+    struct Adapter
+    {
+        Adapter(EventLoop *loop, redisAsyncContext *ac)
+            : loop(loop), context(ac), channel(loop, ac->c.fd)
+        {
+            channel.setReadCallback([this](muduo::Timestamp)
+                                    { redisAsyncHandleRead(context); });
+            channel.setWriteCallback([this]()
+                                     { redisAsyncHandleWrite(context); });
+            // 对端关闭或出错时交给hiredis读取，由它发现错误并断开上下文
+            channel.setCloseCallback([this]()
+                                     { redisAsyncHandleRead(context); });
+            channel.setErrorCallback([this]()
+                                     { redisAsyncHandleRead(context); });
+        }
+
+        EventLoop *loop;
+        redisAsyncContext *context;
+        Channel channel;
+    };
+
+    void addRead(void *privdata) { static_cast<Adapter *>(privdata)->channel.enableReading(); }
+    void delRead(void *privdata) { static_cast<Adapter *>(privdata)->channel.disableReading(); }
+    void addWrite(void *privdata) { static_cast<Adapter *>(privdata)->channel.enableWriting(); }
+    void delWrite(void *privdata) { static_cast<Adapter *>(privdata)->channel.disableWriting(); }
+
+    // 上下文释放时调用，可能正处在该Channel的事件回调中，推迟到下一轮循环再析构
+    void cleanup(void *privdata)
+    {
+        Adapter *adapter = static_cast<Adapter *>(privdata);
+        adapter->channel.disableAll();
+        adapter->channel.remove();
+        adapter->loop->queueInLoop([adapter]()
+                                   { delete adapter; });
+    }
+}
+
+Redis::Redis()
+    : _hsetMetric(Metrics::instance()->histogram("redis.hset")),
+      _hdelMetric(Metrics::instance()->histogram("redis.hdel_if_equal")),
+      _hgetallMetric(Metrics::instance()->histogram("redis.hgetall")),
+      _publishMetric(Metrics::instance()->histogram("redis.publish")),
+      _publishQueueMetric(Metrics::instance()->histogram("redis.publish.queue")),
+      _publishBatchCounter(Metrics::instance()->counter("redis.publish.batches")),
+      _publishMessageCounter(Metrics::instance()->counter("redis.publish.messages")),
+      _receivedMessageCounter(Metrics::instance()->counter("redis.messages_received")),
+      _port(0),
+      _loopThread(EventLoopThread::ThreadInitCallback(), "redis"),
+      _loop(nullptr),
+      _publish_context(nullptr),
+      _subscribe_context(nullptr),
+      _connectedContexts(0),
+      _reconnect(false),
+      _reconnectDelay(kMinReconnectDelay),
+      _batchMaxCount(kDefaultBatchMaxCount),
+      _batchWindow(kDefaultBatchWindow),
+      _flushScheduled(false)
 {
 }
 
 Redis::~Redis()
 {
-    if (_publish_context != nullptr)
+    if (_loop == nullptr)
     {
-        redisFree(_publish_context);
+        return;
     }
 
-    if (_subscribe_context != nullptr)
-    {
-        redisFree(_subscribe_context);
-    }
+    // 上下文只能在Redis的事件循环中释放，等释放完成后再由_loopThread退出循环
+    promise<void> done;
+    _loop->runInLoop([this, &done]()
+                     {
+        // 还没写出的消息先追加到上下文，redisAsyncFree之前会回调它们的结果
+        flushPublishes();
+        // 先置空指针再释放，断开回调认不出这两个上下文，就不会安排重连
+        _reconnect = false;
+        redisAsyncContext *pub = _publish_context;
+        redisAsyncContext *sub = _subscribe_context;
+        _publish_context = nullptr;
+        _subscribe_context = nullptr;
+        if (pub != nullptr)
+        {
+            redisAsyncFree(pub);
+        }
+        if (sub != nullptr)
+        {
+            redisAsyncFree(sub);
+        }
+        done.set_value(); });
+    done.get_future().wait();
 }
 
-// 连接Redis服务器
-bool Redis::connect()
+// 连接Redis服务器，password为空时不做密码验证
+bool Redis::connect(const string &host, int port, const string &password)
 {
-    // 负责publish发布消息的上下文连接
-    _publish_context = redisConnect("127.0.0.1", 6379);
-    if (_publish_context == nullptr)
+    _host = host;
+    _port = port;
+    _password = password;
+    _loop = _loopThread.startLoop();
+
+    // hiredis的异步上下文必须在驱动它的事件循环中创建和使用
+    promise<bool> created;
+    _loop->runInLoop([this, &created]()
+                     {
+        // 负责publish发布消息的上下文连接
+        _publish_context = connectContext();
+        // 负责subscribe订阅消息的上下文连接
+        _subscribe_context = connectContext();
+        created.set_value(_publish_context != nullptr && _subscribe_context != nullptr); });
+    if (!created.get_future().get())
     {
         cerr << "connect redis failed!" << endl;
         return false;
     }
 
-    // 负责subscribe订阅消息的上下文连接
-    _subscribe_context = redisConnect("127.0.0.1", 6379);
-    if (_subscribe_context == nullptr)
+    // 密码验证，命令会排在连接建立之后发出；不需要密码时用PING确认连接已建立
+    // 超时返回后回调仍可能执行，结果用共享指针保证其存活
+    auto authorized = make_shared<atomic_bool>(true);
+    auto onAuth = [authorized](redisReply *reply)
     {
-        cerr << "connect redis failed!" << endl;
+        if (reply == nullptr || reply->type == REDIS_REPLY_ERROR)
+        {
+            *authorized = false;
+        }
+    };
+    vector<string> args = password.empty() ? vector<string>{"PING"} : vector<string>{"AUTH", password};
+    if (!commandSync(&Redis::_publish_context, args, onAuth) ||
+        !commandSync(&Redis::_subscribe_context, args, onAuth) ||
+        !*authorized)
+    {
+        cerr << "authentication failed!" << endl;
         return false;
     }
+    cerr << "authentication succeeded!" << endl;
 
-    // 密码验证
-    redisReply *reply;
+    // 初次连接成功之后，断开的连接才自动重连
+    _loop->runInLoop([this]()
+                     { _reconnect = true; });
 
-    reply = (redisReply *)redisCommand(_publish_context, "AUTH %s", "123456");
-    if (reply->type == REDIS_REPLY_ERROR)
+    // 订阅通道的消息不再需要独立线程阻塞等待，由Redis的事件循环在_subscribe_context可读时回调上报
+    cout << "connect redis-server success!" << endl;
+    return true;
+}
+
+// 在Redis事件循环中创建异步上下文，并挂到muduo的Channel上
+redisAsyncContext *Redis::connectContext()
+{
+    // 非阻塞地发起连接，连接完成前提交的命令先缓存在上下文中
+    redisAsyncContext *ac = redisAsyncConnect(_host.c_str(), _port);
+    if (ac == nullptr)
     {
-        cerr << "authentication failed!" << endl;
+        return nullptr;
     }
-    else
+    if (ac->err)
     {
-        cerr << "authentication succeeded!" << endl;
+        cerr << "redis connect error: " << ac->errstr << endl;
+        redisAsyncFree(ac);
+        return nullptr;
     }
-    freeReplyObject(reply);
 
-    reply = (redisReply *)redisCommand(_subscribe_context, "AUTH %s", "123456");
-    if (reply->type == REDIS_REPLY_ERROR)
+    ac->data = this;
+    Adapter *adapter = new Adapter(_loop, ac);
+    ac->ev.data = adapter;
+    ac->ev.addRead = addRead;
+    ac->ev.delRead = delRead;
+    ac->ev.addWrite = addWrite;
+    ac->ev.delWrite = delWrite;
+    ac->ev.cleanup = cleanup;
+
+    redisAsyncSetConnectCallback(ac, connectCallback);
+    redisAsyncSetDisconnectCallback(ac, disconnectCallback);
+    return ac;
+}
+
+// 连接建立的结果
+void Redis::connectCallback(const redisAsyncContext *ac, int status)
+{
+    Redis *redis = static_cast<Redis *>(ac->data);
+    if (status != REDIS_OK)
     {
-        cerr << "authentication failed!" << endl;
+        // 连接失败时hiredis释放上下文，不会再回调disconnectCallback
+        cerr << "redis connect error: " << ac->errstr << endl;
+        redis->lostContext(ac);
+        return;
+    }
+    ++redis->_connectedContexts;
+    redis->_reconnectDelay = kMinReconnectDelay;
+}
+
+// 连接断开后hiredis会释放上下文，这里把对应的指针置空，重连之前的命令直接失败
+void Redis::disconnectCallback(const redisAsyncContext *ac, int status)
+{
+    Redis *redis = static_cast<Redis *>(ac->data);
+    if (status != REDIS_OK)
+    {
+        cerr << "redis disconnected: " << ac->errstr << endl;
     }
-    else
+    if (redis->_publish_context == ac || redis->_subscribe_context == ac)
     {
-        cerr << "authentication succeeded!" << endl;
+        --redis->_connectedContexts;
     }
-    freeReplyObject(reply);
+    redis->lostContext(ac);
+}
 
-    // 独立线程中接收订阅通道的消息
-    // 监听通道上的事件，有消息给业务层进行上报
-    // 为什么单独的线程监听订阅通道？
-    // 1. subscribe是阻塞等待响应，Chatserver向消息队列订阅后还需要继续提供服务，线程不能因为订阅被阻塞（不能订阅时阻塞的等待这个通道上发生消息）
-    // 2. 1个ChatServer上只有4个线程(1 IO + 3 worker)，如果每次订阅1个通道这个线程就会阻塞住，3个worker线程最多订阅3个通道，无法接受
-    // 3. 新的线程专门以阻塞的方式等待相应的通道是否有事件发生，发生则向业务层上报
-    thread t([&]()
-             { observer_channel_message(); });
-    t.detach();
+// 上下文断开或连接失败后置空对应的指针并安排重连
+void Redis::lostContext(const redisAsyncContext *ac)
+{
+    redisAsyncContext *Redis::*context = nullptr;
+    if (_publish_context == ac)
+    {
+        context = &Redis::_publish_context;
+    }
+    else if (_subscribe_context == ac)
+    {
+        context = &Redis::_subscribe_context;
+    }
+    if (context == nullptr)
+    {
+        // 析构时主动释放的上下文
+        return;
+    }
+    this->*context = nullptr;
+    if (_reconnect)
+    {
+        scheduleReconnect(context);
+    }
+}
 
-    cout << "connect redis-server success!" << endl;
+// 等待退避间隔后重连
+void Redis::scheduleReconnect(redisAsyncContext *Redis::*context)
+{
+    cerr << "redis " << _host << ":" << _port << " lost, reconnect in " << _reconnectDelay << "s" << endl;
+    _loop->runAfter(_reconnectDelay, [this, context]()
+                    { reconnect(context); });
+    _reconnectDelay = std::min(_reconnectDelay * 2, kMaxReconnectDelay);
+}
+
+// 重新创建上下文，命令缓存在上下文中，连接建立后依次发出
+void Redis::reconnect(redisAsyncContext *Redis::*context)
+{
+    if (!_reconnect || this->*context != nullptr)
+    {
+        return;
+    }
+    redisAsyncContext *ac = connectContext();
+    if (ac == nullptr)
+    {
+        scheduleReconnect(context);
+        return;
+    }
+    this->*context = ac;
+
+    if (!_password.empty())
+    {
+        // 密码错误时断开连接，由断开回调安排下一次重连
+        command(context, {"AUTH", _password}, [this, context, ac](redisReply *reply)
+                {
+            if (reply != nullptr && reply->type == REDIS_REPLY_ERROR && this->*context == ac)
+            {
+                cerr << "redis authentication failed: " << string(reply->str, reply->len) << endl;
+                redisAsyncDisconnect(ac);
+            } });
+    }
+    if (context == &Redis::_subscribe_context && !_channels.empty())
+    {
+        // 断开期间通道上的消息已经丢失，只能保证之后的消息继续上报
+        sendSubscribe(vector<string>(_channels.begin(), _channels.end()));
+    }
+}
+
+// 在Redis事件循环中异步执行命令
+bool Redis::command(redisAsyncContext *Redis::*context, vector<string> args, ReplyCallback callback, int metric)
+{
+    if (_loop == nullptr)
+    {
+        return false;
+    }
+
+    // 需要记录耗时的命令在回复到达时计时，连接断开（reply为nullptr）也计入
+    if (metric >= 0)
+    {
+        callback = [metric, start = chrono::steady_clock::now(), callback = std::move(callback)](redisReply *reply)
+        {
+            auto elapsed = chrono::steady_clock::now() - start;
+            Metrics::instance()->record(metric, chrono::duration_cast<chrono::microseconds>(elapsed).count());
+            if (callback)
+            {
+                callback(reply);
+            }
+        };
+    }
+
+    // 任意线程都可以调用，命令连同参数一起投递到Redis的事件循环
+    // 上一轮循环里投递的多条命令会在同一次写事件中发出
+    _loop->runInLoop([this, context, args = std::move(args), callback = std::move(callback)]()
+                     {
+        redisAsyncContext *ac = this->*context;
+        if (ac == nullptr)
+        {
+            cerr << args[0] << " command failed: redis not connected!" << endl;
+            if (callback)
+            {
+                callback(nullptr);
+            }
+            return;
+        }
+
+        // 按长度传递参数，消息可以是二进制帧
+        vector<const char *> argv;
+        vector<size_t> argvlen;
+        argv.reserve(args.size());
+        argvlen.reserve(args.size());
+        for (const string &arg : args)
+        {
+            argv.push_back(arg.data());
+            argvlen.push_back(arg.size());
+        }
+
+        ReplyCallback *privdata = callback ? new ReplyCallback(callback) : nullptr;
+        if (REDIS_OK != redisAsyncCommandArgv(ac, privdata != nullptr ? replyCallback : nullptr, privdata,
+                                              static_cast<int>(argv.size()), argv.data(), argvlen.data()))
+        {
+            cerr << args[0] << " command failed!" << endl;
+            if (privdata != nullptr)
+            {
+                (*privdata)(nullptr);
+                delete privdata;
+            }
+        } });
     return true;
 }
 
+// 执行命令并等待结果，不能在Redis事件循环线程中调用，否则会一直等到超时
+bool Redis::commandSync(redisAsyncContext *Redis::*context, vector<string> args, ReplyCallback callback, int metric)
+{
+    // 超时返回后回调仍可能执行，promise用共享指针保证其存活
+    auto done = make_shared<promise<bool>>();
+    future<bool> result = done->get_future();
+    auto onReply = [done, callback = std::move(callback)](redisReply *reply)
+    {
+        callback(reply);
+        done->set_value(reply != nullptr);
+    };
+    if (!command(context, std::move(args), onReply, metric))
+    {
+        return false;
+    }
+    return result.wait_for(kSyncTimeout) == future_status::ready && result.get();
+}
+
+// 普通命令的结果回调，privdata是提交命令时的回调对象
+void Redis::replyCallback(redisAsyncContext *ac, void *reply, void *privdata)
+{
+    ReplyCallback *callback = static_cast<ReplyCallback *>(privdata);
+    (*callback)(static_cast<redisReply *>(reply));
+    delete callback;
+}
+
 // 向Redis指定的通道channel发布消息
 bool Redis::publish(int channel, string message)
 {
-    // PUBLISH命令一执行立刻响应，不会阻塞当前线程
+    return publish(to_string(channel), message);
+}
+
+bool Redis::publish(const string &channel, const string &message)
+{
+    return publish(channel, make_shared<const string>(message));
+}
+
+bool Redis::publish(int channel, shared_ptr<const string> message, PublishCallback callback)
+{
+    return publish(to_string(channel), std::move(message), std::move(callback));
+}
+
+bool Redis::publish(const string &channel, shared_ptr<const string> message, PublishCallback callback)
+{
+    // 只把PUBLISH放进待写出的批次，不等待响应，业务线程不会因为Redis的往返而阻塞
     // 相当于publish 键 值
     // redis 127.0.0.1:6379> PUBLISH runoobChat "Redis PUBLISH test"
-    redisReply *reply = (redisReply *)redisCommand(_publish_context, "PUBLISH %d %s", channel, message.c_str());
-    if (reply == nullptr)
+    if (_loop == nullptr)
     {
-        cerr << "publish command failed!" << endl;
         return false;
     }
 
-    // 返回值是动态生成的结构体，用完需要free释放资源
-    freeReplyObject(reply);
+    bool flushNow = false;
+    bool scheduleFlush = false;
+    {
+        lock_guard<mutex> lock(_pendingMutex);
+        _pendingPublishes.push_back({channel, std::move(message), std::move(callback), chrono::steady_clock::now()});
+        if (_pendingPublishes.size() >= _batchMaxCount)
+        {
+            flushNow = true;
+        }
+        else if (!_flushScheduled)
+        {
+            // 批次里的第一条消息负责安排定时写出，最多等待一个窗口
+            _flushScheduled = true;
+            scheduleFlush = true;
+        }
+    }
+
+    if (flushNow)
+    {
+        _loop->queueInLoop([this]()
+                           { flushPublishes(); });
+    }
+    else if (scheduleFlush)
+    {
+        if (_batchWindow > 0)
+        {
+            _loop->runAfter(_batchWindow, [this]()
+                            { flushPublishes(); });
+        }
+        else
+        {
+            // 不设窗口时只合并同一轮事件循环之前到达的消息
+            _loop->queueInLoop([this]()
+                               { flushPublishes(); });
+        }
+    }
     return true;
 }
 
-// 向Redis指定的通道subscribe订阅消息
-bool Redis::subscribe(int channel)
+// 设置发布批处理的参数
+void Redis::setPublishBatch(size_t maxCount, double window)
 {
-    // redisCommand：redisAppendCommand+redisBufferWrite+redisGetReply
-    // 1. 把SUBSCRIBE命令组装好后写到本地缓存
-    // 2. 从本地缓存把命令发送到Redis Server上
-    // 3. redisGetReply：以阻塞的方式等待远端的响应
-    // 这里只调用前2个函数，告诉Redis Server要订阅这个通道，不会阻塞等待Redis Server的响应
+    lock_guard<mutex> lock(_pendingMutex);
+    _batchMaxCount = maxCount > 0 ? maxCount : 1;
+    _batchWindow = window;
+}
 
-    // SUBSCRIBE命令本身会造成线程阻塞等待通道里面发生消息，这里只做订阅通道，不接收通道消息
-    // 通道消息的接收专门在observer_channel_message函数中的独立线程中进行
-    // 只负责发送命令，不阻塞接收Redis server响应消息，否则和notifyMsg线程抢占响应资源
-    // redis 127.0.0.1:6379> SUBSCRIBE runoobChat
-    if (REDIS_ERR == redisAppendCommand(_subscribe_context, "SUBSCRIBE %d", channel))
+// 等待写出的PUBLISH条数
+size_t Redis::pendingPublishes()
+{
+    lock_guard<mutex> lock(_pendingMutex);
+    return _pendingPublishes.size();
+}
+
+// 在Redis事件循环中把攒下的PUBLISH一次性追加到上下文
+// hiredis只是把命令追加到输出缓冲区，整个批次在下一次可写时用一次写出，即流水线
+void Redis::flushPublishes()
+{
+    vector<PendingPublish> batch;
     {
-        cerr << "subscribe command failed!" << endl;
-        return false;
+        lock_guard<mutex> lock(_pendingMutex);
+        batch.swap(_pendingPublishes);
+        _flushScheduled = false;
     }
-    // redisBufferWrite可以循环发送缓冲区，直到缓冲区数据发送完毕（done被置为1）
-    int done = 0;
-    while (!done)
+    if (batch.empty())
     {
-        if (REDIS_ERR == redisBufferWrite(_subscribe_context, &done))
+        return;
+    }
+
+    Metrics *metrics = Metrics::instance();
+    metrics->add(_publishBatchCounter);
+    metrics->add(_publishMessageCounter, batch.size());
+    auto now = chrono::steady_clock::now();
+
+    for (PendingPublish &pending : batch)
+    {
+        if (_publish_context == nullptr)
+        {
+            if (pending.callback)
+            {
+                pending.callback(false, 0);
+            }
+            continue;
+        }
+
+        // 消息可能是二进制帧，按长度传递
+        const char *argv[] = {"PUBLISH", pending.channel.data(), pending.message->data()};
+        size_t argvlen[] = {strlen("PUBLISH"), pending.channel.size(), pending.message->size()};
+
+        // 在批次中等待的时间对每条消息都记录；往返耗时只对需要回复的消息记录，其余消息不为计时分配回调
+        metrics->record(_publishQueueMetric, chrono::duration_cast<chrono::microseconds>(now - pending.start).count());
+        ReplyCallback *privdata = nullptr;
+        if (pending.callback)
+        {
+            privdata = new ReplyCallback([this, start = pending.start, callback = std::move(pending.callback)](redisReply *reply)
+                                         {
+                auto elapsed = chrono::steady_clock::now() - start;
+                Metrics::instance()->record(_publishMetric, chrono::duration_cast<chrono::microseconds>(elapsed).count());
+                bool ok = reply != nullptr && reply->type == REDIS_REPLY_INTEGER;
+                callback(ok, ok ? reply->integer : 0); });
+        }
+        if (REDIS_OK != redisAsyncCommandArgv(_publish_context, privdata != nullptr ? replyCallback : nullptr, privdata,
+                                              3, argv, argvlen))
         {
-            cerr << "subscribe command failed!" << endl;
-            return false;
+            cerr << "publish command failed!" << endl;
+            if (privdata != nullptr)
+            {
+                (*privdata)(nullptr);
+                delete privdata;
+            }
         }
     }
-    // redisGetReply
+}
 
-    return true;
+// 设置哈希表key中字段field的值
+bool Redis::hset(const string &key, const string &field, const string &value)
+{
+    return command(&Redis::_publish_context, {"HSET", key, field, value}, ReplyCallback(), _hsetMetric);
 }
 
-// 向redis指定的通道unsubscribe取消订阅消息
-bool Redis::unsubscribe(int channel)
+// 仅当字段的当前值等于value时才删除，比较和删除在Redis中原子执行
+bool Redis::hdelIfEqual(const string &key, const string &field, const string &value)
+{
+    static const string script =
+        "if redis.call('HGET', KEYS[1], ARGV[1]) == ARGV[2] then "
+        "return redis.call('HDEL', KEYS[1], ARGV[1]) end return 0";
+    return command(&Redis::_publish_context, {"EVAL", script, "1", key, field, value}, ReplyCallback(), _hdelMetric);
+}
+
+// 读取哈希表key的全部字段，等待结果返回
+bool Redis::hgetall(const string &key, vector<pair<string, string>> &entries)
 {
-    // redisCommand 会先把命令缓存到context中，然后调用RedisAppendCommand发送给redis
-    // redis执行subscribe是阻塞，不会响应，不会给我们一个reply
-    if (REDIS_ERR == redisAppendCommand(_subscribe_context, "UNSUBSCRIBE %d", channel))
+    // 回调在Redis线程中执行，先收集到局部变量，commandSync返回后调用方才能看到结果
+    auto result = make_shared<vector<pair<string, string>>>();
+    bool ok = commandSync(&Redis::_publish_context, {"HGETALL", key}, [result](redisReply *reply)
+                          {
+        // 回复是字段和值交替排列的数组
+        if (reply != nullptr && reply->type == REDIS_REPLY_ARRAY)
+        {
+            for (size_t i = 0; i + 1 < reply->elements; i += 2)
+            {
+                result->emplace_back(string(reply->element[i]->str, reply->element[i]->len),
+                                     string(reply->element[i + 1]->str, reply->element[i + 1]->len));
+            }
+        } }, _hgetallMetric);
+    if (!ok)
     {
-        cerr << "unsubscribe command failed!" << endl;
+        cerr << "hgetall command failed!" << endl;
         return false;
     }
-    // redisBufferWrite可以循环发送缓冲区，直到缓冲区数据发送完毕（done被置为1）
-    int done = 0;
-    while (!done)
+    entries.insert(entries.end(), result->begin(), result->end());
+    return true;
+}
+
+// 等待此前投递的命令都执行完成
+bool Redis::sync()
+{
+    if (_loop == nullptr)
     {
-        if (REDIS_ERR == redisBufferWrite(_subscribe_context, &done))
-        {
-            cerr << "unsubscribe command failed!" << endl;
-            return false;
-        }
+        return false;
     }
+    // 先写出攒着的PUBLISH，同一上下文上的命令按顺序执行，PING返回时之前的命令都已执行
+    _loop->runInLoop([this]()
+                     { flushPublishes(); });
+    return commandSync(&Redis::_publish_context, {"PING"}, [](redisReply *) {});
+}
+
+// 向Redis指定的通道subscribe订阅消息
+bool Redis::subscribe(int channel)
+{
+    return subscribe(to_string(channel));
+}
 
+bool Redis::subscribe(const string &channel)
+{
+    // 订阅命令的回调会一直保留，该通道上的每条消息都会回调subscribeCallback
+    // 回调在Redis的事件循环中执行，不需要独立线程阻塞等待通道消息
+    // redis 127.0.0.1:6379> SUBSCRIBE runoobChat
+    if (_loop == nullptr)
+    {
+        return false;
+    }
+    _loop->runInLoop([this, channel]()
+                     {
+        // 记下通道，断开时也记下，重连后一起订阅
+        _channels.insert(channel);
+        sendSubscribe({channel}); });
     return true;
 }
 
-// 独立线程中接收订阅通道的消息
-void Redis::observer_channel_message()
+// 在Redis事件循环中向订阅上下文发送SUBSCRIBE，一条命令可以订阅多个通道
+void Redis::sendSubscribe(const vector<string> &channels)
 {
-    // 以循环阻塞的方式等待_subscribe_context上下文上是否有消息发生
-    redisReply *reply = nullptr;
-    while (REDIS_OK == redisGetReply(_subscribe_context, (void **)&reply))
+    if (_subscribe_context == nullptr)
     {
-        // 订阅收到的消息是一个带三元素的数组，0.message, 1.通道号，2.消息
-        if (reply != nullptr && reply->element[2] != nullptr && reply->element[2]->str != nullptr)
-        {
-            // 调用回调操作，给业务层上报通道上发生的消息(通道号，通道上的数据)
-            _notify_message_handler(atoi(reply->element[1]->str), reply->element[2]->str);
-        }
+        cerr << "subscribe command failed: redis not connected!" << endl;
+        return;
+    }
+    vector<const char *> argv{"SUBSCRIBE"};
+    vector<size_t> argvlen{strlen("SUBSCRIBE")};
+    for (const string &channel : channels)
+    {
+        argv.push_back(channel.data());
+        argvlen.push_back(channel.size());
+    }
+    if (REDIS_OK != redisAsyncCommandArgv(_subscribe_context, subscribeCallback, this,
+                                          static_cast<int>(argv.size()), argv.data(), argvlen.data()))
+    {
+        cerr << "subscribe command failed!" << endl;
+    }
+}
+
+// 向redis指定的通道unsubscribe取消订阅消息
+bool Redis::unsubscribe(int channel)
+{
+    // 取消订阅确认后hiredis会移除该通道的回调
+    if (_loop == nullptr)
+    {
+        return false;
+    }
+    string name = to_string(channel);
+    _loop->runInLoop([this, name]()
+                     { _channels.erase(name); });
+    return command(&Redis::_subscribe_context, {"UNSUBSCRIBE", name});
+}
 
-        freeReplyObject(reply);
+// 订阅通道上的消息，在Redis的事件循环中回调
+void Redis::subscribeCallback(redisAsyncContext *ac, void *r, void *privdata)
+{
+    Redis *redis = static_cast<Redis *>(privdata);
+    redisReply *reply = static_cast<redisReply *>(r);
+    // 订阅收到的消息是一个带三元素的数组，0.message, 1.通道号，2.消息
+    // subscribe/unsubscribe的确认也会回调到这里，直接忽略
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY || reply->elements < 3 ||
+        reply->element[0]->str == nullptr || strcmp(reply->element[0]->str, "message") != 0 ||
+        reply->element[2]->str == nullptr)
+    {
+        return;
     }
 
-    cerr << "----------------------- oberver_channel_message quit --------------------------" << endl;
+    Metrics::instance()->add(redis->_receivedMessageCounter);
+
+    // 调用回调操作，给业务层上报通道上发生的消息(通道号，通道上的数据)
+    // 用户id命名的通道上报给消息回调，其他命名的通道上报给控制回调
+    // reply由hiredis在回调返回后释放，这里不能free
+    string channel(reply->element[1]->str, reply->element[1]->len);
+    string message(reply->element[2]->str, reply->element[2]->len);
+    if (channel.find_first_not_of("0123456789") == string::npos)
+    {
+        redis->_notify_message_handler(atoi(channel.c_str()), message);
+    }
+    else if (redis->_notify_control_handler)
+    {
+        redis->_notify_control_handler(channel, message);
+    }
 }
 
 // 初始化向业务层上报通道消息的回调对象
 void Redis::init_notify_handler(redis_handler handler)
 {
     _notify_message_handler = handler;
-}
\ No newline at end of file
+}
+
+// 初始化上报控制通道消息的回调对象
+void Redis::init_control_handler(redis_control_handler handler)
+{
+    _notify_control_handler = handler;
+}
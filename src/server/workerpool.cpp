@@ -0,0 +1,93 @@
+#include "workerpool.hpp"
+
+WorkerPool::WorkerPool(int threadNum, size_t queueCapacity)
+    : _queueCapacity(queueCapacity), _running(false)
+{
+    for (int i = 0; i < threadNum; ++i)
+    {
+        _workers.emplace_back(new Worker);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+// 启动工作线程
+void WorkerPool::start()
+{
+    _running = true;
+    for (auto &worker : _workers)
+    {
+        worker->thread = std::thread(std::bind(&WorkerPool::runInThread, this, worker.get()));
+    }
+}
+
+// 处理完已投递的任务后停止工作线程
+void WorkerPool::stop()
+{
+    if (!_running.exchange(false))
+    {
+        return;
+    }
+    for (auto &worker : _workers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->notEmpty.notify_all();
+        worker->notFull.notify_all();
+    }
+    for (auto &worker : _workers)
+    {
+        worker->thread.join();
+    }
+}
+
+// 按key投递任务，同一key总是落在同一个工作线程上
+void WorkerPool::submit(size_t key, Task task)
+{
+    Worker *worker = _workers[key % _workers.size()].get();
+    std::unique_lock<std::mutex> lock(worker->mutex);
+    worker->notFull.wait(lock, [&]()
+                         { return worker->tasks.size() < _queueCapacity || !_running; });
+    worker->tasks.push_back(std::move(task));
+    lock.unlock();
+    worker->notEmpty.notify_one();
+}
+
+// 所有队列中等待处理的任务数
+size_t WorkerPool::queueSize() const
+{
+    size_t size = 0;
+    for (const auto &worker : _workers)
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        size += worker->tasks.size();
+    }
+    return size;
+}
+
+// 工作线程的主循环
+void WorkerPool::runInThread(Worker *worker)
+{
+    for (;;)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(worker->mutex);
+            worker->notEmpty.wait(lock, [&]()
+                                  { return !worker->tasks.empty() || !_running; });
+            // 停止时把队列中剩余的任务处理完再退出
+            if (worker->tasks.empty())
+            {
+                return;
+            }
+            task = std::move(worker->tasks.front());
+            worker->tasks.pop_front();
+        }
+        worker->notFull.notify_one();
+        task();
+    }
+}